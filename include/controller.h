@@ -0,0 +1,102 @@
+// 温控命令处理与调度
+// 命令解析、温控曲线调度（tempEvent）、状态推送和轨迹录制都在 src/controller.cpp 中，
+// 只通过下面的平台钩子访问硬件：固件在 main.cpp 中实现，主机回放工具（tools/replay_trace.cpp）用虚拟时钟实现
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "controller_config.h"
+#include "profile_analyzer.h"
+#include "ota_receiver.h"
+
+// 设置按键（温控器面板）
+const int KEY1 = 6;   //设定
+const int KEY2 = 10;  //减
+const int KEY3 = 3;   //加
+const int KEY4 = 2;   //左移
+
+// 定义 LED 状态
+enum LEDState {
+    WAITING_FOR_CONNECTION,
+    CONNECTION_SUCCESS,
+    RECEIVING_SUCCESS,
+    EXECUTING,
+    EXECUTING_WITHOUT_CONECT,
+    COMPLETED
+};
+
+// 当前状态，初始为等待连接
+extern volatile LEDState currentState;
+
+// 按键事件，由按键状态机投递给命令任务
+enum ButtonEvent {
+    BUTTON_SHORT_PRESS,   // 短按释放（< 3 秒）
+    BUTTON_LONG_HOLD,     // 按住已满 3 秒（提示松开即执行）
+    BUTTON_LONG_PRESS,    // 按住 3~10 秒后释放
+    BUTTON_RESET_HOLD     // 按住已满 10 秒
+};
+
+// 命令执行结果（批量命令中逐条返回）
+enum CommandStatus {
+    CMD_OK = 0,             // 执行成功
+    CMD_UNKNOWN = 1,        // 未知命令
+    CMD_BAD_REQUEST = 2,    // 缺少命令名或参数格式错误
+    CMD_INVALID_STATE = 3   // 当前状态下无法执行（例如未运行时中断）
+};
+
+// 命令轨迹录制（用于复现问题和回放测试）
+// 每条记录：4 字节时间戳（相对录制开始，毫秒）+ 1 字节类型 + 2 字节长度 + 数据，均为小端
+const int TRACE_BUFFER_SIZE = 8192;   // 轨迹缓冲区大小，写满后停止录制
+const int TRACE_RECORD_HEADER = 7;    // 记录头长度
+const int TRACE_DUMP_CHUNK = 200;     // 每次导出的最大字节数（十六进制后 400 字符）
+
+enum TraceRecordType {
+    TRACE_COMMAND = 1,       // 收到的原始写入数据
+    TRACE_COMMAND_DONE = 2,  // 命令处理完成，数据为 4 字节处理耗时（微秒）
+    TRACE_CONNECT = 3,       // 设备连接
+    TRACE_DISCONNECT = 4,    // 设备断开
+    TRACE_BUTTON = 5,        // 按键事件，数据为 1 字节 ButtonEvent
+    TRACE_SNAPSHOT = 6       // 录制开始时的设备状态，总是第一条记录，格式见下
+};
+
+// 状态快照（小端）：EEPROM 全部内容，随后为
+//   +0  1 字节标志：bit0 曲线已启动（isStart），bit1 运行中（isRunning），bit2 已连接
+//   +1  1 字节当前温控段（currentEvent）
+//   +2  4 字节曲线已运行时间（毫秒）
+//   +6  4 字节上次插值时间（分钟）
+//   +10 4 字节距上次 tempEvent() 检查的时间（毫秒）
+//   +14 2 字节当前设定温度
+//   +16 1 字节 LED 状态
+//   +17 1 字节订阅字段
+//   +18 2 字节订阅最小间隔（毫秒）
+//   +20 2 字节订阅心跳（毫秒）
+//   +22 4 字节距上次状态推送的时间（毫秒）
+const int TRACE_SNAPSHOT_SIZE = EEPROM_SIZE + 26;
+
+// 固件升级接收流程，由平台提供 OtaPlatform 实现
+extern OtaReceiver ota;
+
+// ---- 平台钩子 ----
+unsigned long platformMillis();
+unsigned long platformMicros();
+void platformDelay(unsigned long ms);
+void platformKeyWrite(int key, bool pressed);              // 温控器按键，pressed 为 true 时拉低
+void platformNotify(const uint8_t *data, size_t length);   // 通过 BLE 通知发送给客户端
+uint8_t platformStorageRead(int addr);                     // EEPROM
+void platformStorageWrite(int addr, uint8_t value);
+bool platformStorageCommit();
+void platformLog(const char *format, ...);                 // 串口日志
+void platformRestart();
+bool platformLinkSecure();                                 // 当前连接是否已加密；未加密时发起配对并返回 false
+void platformLock();                                       // 轨迹缓冲区互斥，BLE、定时器和命令任务都会写入
+void platformUnlock();
+
+// ---- 入口 ----
+void controllerBegin();                                    // 上电初始化：恢复默认状态，检查 EEPROM
+void controllerLoop();                                     // 主循环中反复调用
+void handleWrite(const uint8_t *data, size_t length);      // 收到一次特征写入
+void handleConnect();
+void handleDisconnect();
+void handleButtonEvent(ButtonEvent event);
+void sendOtaStatus(const char* status);
+bool restoreSnapshot(const uint8_t *data, size_t length);  // 恢复 TRACE_SNAPSHOT 记录的状态（回放工具使用）
@@ -0,0 +1,16 @@
+// 温控器配置：EEPROM 布局、按键时序和调度参数
+// 固件（controller.h）和温控曲线分析器（profile_analyzer.h）都以这里为准
+#pragma once
+
+// 按键时序（毫秒），每次按键为按下和松开各保持一次
+const int KEY_CONFIRM_HOLD_MS = 50; // KEY1（设定）
+const int KEY_STEP_HOLD_MS = 25;    // KEY2（减）、KEY3（加）、KEY4（左移）
+
+// EEPROM 布局：每个温控点 2 字节时间（分钟）+ 2 字节温度，均为小端
+const int MAX_TEMPERATURE_POINTS = 15;             // 温控点数
+const int BYTES_PER_POINT = 4;
+const int EEPROM_SIZE = MAX_TEMPERATURE_POINTS * BYTES_PER_POINT;
+
+// tempEvent() 调度参数
+const unsigned long TEMP_EVENT_INTERVAL_MS = 5000; // tempEvent() 检查间隔（毫秒）
+const int INTERPOLATION_INTERVAL_MINUTES = 1;      // 插值间隔（分钟）
@@ -0,0 +1,200 @@
+// BLE 固件升级（OTA）接收流程
+// 不依赖 ESP-IDF，固件和主机基准测试工具（tools/ota_benchmark.cpp）共用同一份代码，
+// 分区写入、SHA-256、确认发送和时钟通过 OtaPlatform 注入
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+// 数据包写入 OTA 数据特征（无响应写入）：4 字节小端偏移 + 固件数据
+const uint32_t OTA_DEFAULT_WINDOW = 4096;       // 默认确认窗口（字节）
+const uint32_t OTA_MIN_WINDOW = 512;            // 最小确认窗口（字节）
+const uint32_t OTA_MAX_WINDOW = 65536;          // 最大确认窗口（字节）
+const size_t OTA_PACKET_HEADER = 4;             // 数据包头长度（偏移）
+const size_t OTA_SHA256_HEX_LENGTH = 64;        // SHA-256 十六进制长度
+
+enum OtaState {
+    OTA_IDLE,        // 未开始
+    OTA_RECEIVING,   // 接收中（断开后保留，可从偏移处续传）
+    OTA_VERIFIED,    // 校验通过，等待切换分区
+    OTA_FAILED       // 写入或校验失败
+};
+
+enum OtaResult {
+    OTA_OK,              // 执行成功
+    OTA_BAD_REQUEST,     // 参数错误、固件过大或校验不通过
+    OTA_INVALID_STATE    // 当前状态下无法执行（未接收完、曲线运行中、分区操作失败）
+};
+
+// 平台相关操作：固件中为 esp_ota_* 和 mbedtls，主机工具中为内存中的 flash 替身
+class OtaPlatform {
+public:
+    virtual ~OtaPlatform() {}
+
+    virtual uint32_t partitionSize() = 0;                            // 目标分区大小，0 表示不可用
+    virtual bool flashBegin(uint32_t size) = 0;                      // 打开非当前运行分区
+    virtual bool flashWrite(const uint8_t *data, size_t length) = 0;
+    virtual bool flashEnd() = 0;                                     // 结束写入并校验镜像
+    virtual void flashAbort() = 0;
+    virtual bool activate() = 0;                                     // 切换启动分区
+
+    virtual void shaStart() = 0;
+    virtual void shaUpdate(const uint8_t *data, size_t length) = 0;
+    virtual void shaFinish(uint8_t digest[32]) = 0;
+
+    virtual void sendAck(uint32_t offset, bool rewind) = 0;          // 通知客户端下一个期望偏移，rewind 表示需从该偏移重发
+    virtual unsigned long now() = 0;                                 // 毫秒时钟
+};
+
+class OtaReceiver {
+public:
+    explicit OtaReceiver(OtaPlatform &platform) : platform(platform) {}
+
+    OtaState state() const { return currentState; }
+    uint32_t offset() const { return currentOffset; }
+    uint32_t size() const { return imageSize; }
+    uint32_t window() const { return ackWindow; }
+    unsigned long elapsedMs() { return platform.now() - startMillis; }
+
+    const char* stateName() const {
+        switch (currentState) {
+            case OTA_RECEIVING: return "receiving";
+            case OTA_VERIFIED:  return "verified";
+            case OTA_FAILED:    return "failed";
+            default:            return "idle";
+        }
+    }
+
+    // 本次传输（含续传）的吞吐（字节/秒）
+    uint32_t throughput() {
+        unsigned long elapsed = elapsedMs();
+        if (elapsed == 0) return 0;
+        return (uint64_t)(currentOffset - startOffset) * 1000 / elapsed;
+    }
+
+    void abort() {
+        if (currentState == OTA_RECEIVING) {
+            platform.flashAbort();
+        }
+        currentState = OTA_IDLE;
+        currentOffset = 0;
+        imageSize = 0;
+    }
+
+    // 开始或续传：若大小和 SHA-256 与未完成的传输一致，则保留已写入的数据，从当前偏移续传
+    OtaResult begin(uint32_t size, const char *sha, uint32_t window) {
+        if (size == 0 || sha == nullptr || strlen(sha) != OTA_SHA256_HEX_LENGTH) {
+            return OTA_BAD_REQUEST;
+        }
+
+        if (window < OTA_MIN_WINDOW) window = OTA_MIN_WINDOW;
+        if (window > OTA_MAX_WINDOW) window = OTA_MAX_WINDOW;
+        ackWindow = window;
+
+        if (!(currentState == OTA_RECEIVING && size == imageSize && strcasecmp(sha, expectedSha) == 0)) {
+            abort();
+            if (size > platform.partitionSize()) {
+                return OTA_BAD_REQUEST;
+            }
+            if (!platform.flashBegin(size)) {
+                currentState = OTA_FAILED;
+                return OTA_INVALID_STATE;
+            }
+            platform.shaStart();
+            strncpy(expectedSha, sha, sizeof(expectedSha) - 1);
+            imageSize = size;
+            currentOffset = 0;
+            currentState = OTA_RECEIVING;
+        }
+
+        startMillis = platform.now();
+        startOffset = currentOffset;
+        lastAck = currentOffset;
+        nackSent = false;
+        return OTA_OK;
+    }
+
+    // 处理一个数据包，只接受期望偏移处的数据；乱序或重复的包丢弃并回报期望偏移
+    // 写入失败时返回 false，传输进入失败状态
+    bool handlePacket(const uint8_t *packet, size_t length) {
+        if (currentState != OTA_RECEIVING || length <= OTA_PACKET_HEADER) return true;
+
+        uint32_t packetOffset = packet[0] | (packet[1] << 8) | (packet[2] << 16) | ((uint32_t)packet[3] << 24);
+        const uint8_t *payload = packet + OTA_PACKET_HEADER;
+        size_t payloadLength = length - OTA_PACKET_HEADER;
+
+        if (packetOffset != currentOffset || currentOffset + payloadLength > imageSize) {
+            if (!nackSent) {
+                sendAck(true);
+                nackSent = true;
+            }
+            return true;
+        }
+
+        if (!platform.flashWrite(payload, payloadLength)) {
+            abort();
+            currentState = OTA_FAILED;
+            return false;
+        }
+        platform.shaUpdate(payload, payloadLength);
+        currentOffset += payloadLength;
+        nackSent = false;
+
+        if (currentOffset - lastAck >= ackWindow || currentOffset == imageSize) {
+            sendAck(false);
+        }
+        return true;
+    }
+
+    // 校验并切换分区；profileRunning 为 true 时只校验，不切换
+    OtaResult end(bool profileRunning) {
+        if (currentState == OTA_RECEIVING) {
+            if (currentOffset != imageSize) {
+                return OTA_INVALID_STATE;
+            }
+
+            uint8_t digest[32];
+            char hex[OTA_SHA256_HEX_LENGTH + 1];
+            platform.shaFinish(digest);
+            for (int i = 0; i < 32; i++) {
+                snprintf(hex + i * 2, 3, "%02x", digest[i]);
+            }
+
+            bool flashOk = platform.flashEnd();
+            if (strcasecmp(hex, expectedSha) != 0 || !flashOk) {
+                currentState = OTA_FAILED;
+                return OTA_BAD_REQUEST;
+            }
+            currentState = OTA_VERIFIED;
+        }
+
+        if (currentState != OTA_VERIFIED || profileRunning) {
+            return OTA_INVALID_STATE;
+        }
+        if (!platform.activate()) {
+            currentState = OTA_FAILED;
+            return OTA_INVALID_STATE;
+        }
+        return OTA_OK;
+    }
+
+private:
+    void sendAck(bool rewind) {
+        platform.sendAck(currentOffset, rewind);
+        lastAck = currentOffset;
+    }
+
+    OtaPlatform &platform;
+    volatile OtaState currentState = OTA_IDLE;
+    uint32_t imageSize = 0;                     // 固件总长度
+    uint32_t currentOffset = 0;                 // 已写入的字节数，即下一个期望偏移
+    uint32_t ackWindow = OTA_DEFAULT_WINDOW;    // 每写入多少字节确认一次
+    uint32_t lastAck = 0;                       // 上次确认时的偏移
+    bool nackSent = false;                      // 乱序包只回一次确认，避免刷屏
+    char expectedSha[OTA_SHA256_HEX_LENGTH + 1] = {0}; // 客户端给出的 SHA-256（十六进制）
+    unsigned long startMillis = 0;              // 本次传输（含续传）开始时间
+    uint32_t startOffset = 0;                   // 本次传输开始时的偏移，用于计算吞吐
+};
@@ -0,0 +1,162 @@
+// 温控曲线代价分析
+// 不依赖 Arduino，固件（analyze_profile 命令）和主机工具（tools/analyze_profile.cpp）共用同一份代码
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include "controller_config.h"
+
+const int ANALYSIS_MAX_MINUTES = 1000;        // 温控点时间上限（分钟），与 EEPROM 有效性判断一致
+const int ANALYSIS_MAX_TEMPERATURE = 999;     // 温控器只能输入三位数
+const int ANALYSIS_MAX_REPORTED_MINUTES = 16; // 最多列出的丢弃/延迟分钟数
+
+struct ProfilePoint {
+    int time;         // 分钟
+    int temperature;  // °C
+};
+
+struct ProfileAnalysis {
+    uint32_t presses;      // 总按键次数
+    uint32_t blockedMs;    // 面板处于编辑状态（按键序列执行中）的累计时间
+    uint32_t durationMs;   // 曲线执行总时长
+    uint32_t updates;      // setTemp() 调用次数
+    uint32_t worstLagMs;   // 设定值从应当生效到实际写入完成的最大延迟
+    int worstLagMinute;    // 最大延迟对应的分钟
+    int maxError;          // 理想曲线与已写入设定值的最大偏差（°C）
+    int droppedCount;      // 没有任何设定值更新的分钟数
+    int delayedCount;      // 更新延迟超过阈值的分钟数
+    int dropped[ANALYSIS_MAX_REPORTED_MINUTES];
+    int delayed[ANALYSIS_MAX_REPORTED_MINUTES];
+};
+
+// 时间在 [0, 1000) 分钟内、温度为三位以内非负数的温控点才能被模拟
+inline bool profilePointValid(const ProfilePoint &point) {
+    return point.time >= 0 && point.time < ANALYSIS_MAX_MINUTES &&
+           point.temperature >= 0 && point.temperature <= ANALYSIS_MAX_TEMPERATURE;
+}
+
+// setTempZero() + setTemp(a) 的按键次数
+inline int setTempPresses(int a) {
+    int digits = a % 10 + (a / 10) % 10 + a / 100;
+    return 7 + 4 + digits;
+}
+
+// setTempZero() + setTemp(a) 的耗时（毫秒）
+inline uint32_t setTempDurationMs(int a) {
+    int digits = a % 10 + (a / 10) % 10 + a / 100;
+    uint32_t confirm = 2 * KEY_CONFIRM_HOLD_MS;
+    uint32_t step = 2 * KEY_STEP_HOLD_MS;
+    return 2 * confirm + 5 * step     // setTempZero(): KEY1、KEY4 x3、KEY2 x2、KEY1
+         + 2 * confirm + 2 * step     // setTemp(): KEY1、KEY4 x2、KEY1
+         + digits * step;             // KEY3 按各位数字
+}
+
+// 理想曲线在 t 毫秒处的温度（温控点之间线性插值）
+inline float profileIdeal(const ProfilePoint *points, int count, uint32_t t) {
+    float minute = t / 60000.0f;
+    if (minute <= points[0].time) return points[0].temperature;
+    for (int i = 1; i < count; i++) {
+        if (minute <= points[i].time) {
+            float span = points[i].time - points[i - 1].time;
+            if (span <= 0) return points[i].temperature;
+            return points[i - 1].temperature +
+                   (points[i].temperature - points[i - 1].temperature) * (minute - points[i - 1].time) / span;
+        }
+    }
+    return points[count - 1].temperature;
+}
+
+inline void analysisMarkMinute(int *list, int &count, int minute) {
+    if (count < ANALYSIS_MAX_REPORTED_MINUTES) list[count] = minute;
+    count++;
+}
+
+// 按 tempEvent() 的逻辑模拟一次完整运行：
+// 每 tickMs 检查一次，到达温控点时写入该点温度，否则每 interpolationMinutes 分钟写入一次插值温度，
+// 按键序列执行期间主循环阻塞，下一次检查在序列结束后 tickMs 才发生。
+// eventLimit 为实际会执行的温控点数（固件中最后一个温控点位置不会被执行）。
+// 更新延迟超过 delayThresholdMs 的分钟记为延迟。
+// 存在无效温控点时不模拟并返回 false，保证模拟时长有上限。
+inline bool analyzeProfile(const ProfilePoint *points, int count, int eventLimit,
+                           uint32_t tickMs, int interpolationMinutes, uint32_t delayThresholdMs,
+                           ProfileAnalysis &out) {
+    out = ProfileAnalysis();
+    if (count <= 0) return false;
+    for (int i = 0; i < count; i++) {
+        if (!profilePointValid(points[i])) return false;
+    }
+    if (eventLimit > count) eventLimit = count;
+
+    uint8_t covered[ANALYSIS_MAX_MINUTES / 8 + 1] = {0};
+    uint32_t t = 0;
+    int currentEvent = 0;
+    int lastInterpolation = 0;
+    int applied = 0;
+    bool hasApplied = false;
+
+    while (currentEvent < eventLimit) {
+        int minute = t / 60000;
+        bool issue = false;
+        int target = 0;
+        uint32_t intendedAt = 0;
+
+        if (minute >= points[currentEvent].time) {
+            target = points[currentEvent].temperature;
+            intendedAt = (uint32_t)points[currentEvent].time * 60000;
+            currentEvent++;
+            lastInterpolation = minute;
+            issue = true;
+        } else if (minute - lastInterpolation >= interpolationMinutes && currentEvent > 0) {
+            float timeDiff = points[currentEvent].time - points[currentEvent - 1].time;
+            if (timeDiff > 0) {
+                float tempDiff = points[currentEvent].temperature - points[currentEvent - 1].temperature;
+                float fraction = (minute - points[currentEvent - 1].time) / timeDiff;
+                target = points[currentEvent - 1].temperature + (int)round(tempDiff * fraction);
+                intendedAt = (uint32_t)minute * 60000;
+                issue = true;
+            }
+            lastInterpolation = minute;
+        }
+
+        if (issue) {
+            uint32_t cost = setTempDurationMs(target);
+            out.presses += setTempPresses(target);
+            out.blockedMs += cost;
+            out.updates++;
+            t += cost;
+            applied = target;
+            hasApplied = true;
+
+            int intendedMinute = intendedAt / 60000;
+            uint32_t lag = t - intendedAt;
+            if (lag > out.worstLagMs) {
+                out.worstLagMs = lag;
+                out.worstLagMinute = intendedMinute;
+            }
+            if (lag > delayThresholdMs) {
+                analysisMarkMinute(out.delayed, out.delayedCount, intendedMinute);
+            }
+            if (intendedMinute >= 0 && intendedMinute < ANALYSIS_MAX_MINUTES) {
+                covered[intendedMinute / 8] |= 1 << (intendedMinute % 8);
+            }
+        }
+
+        if (hasApplied) {
+            int error = (int)fabs(profileIdeal(points, count, t) - applied);
+            if (error > out.maxError) out.maxError = error;
+        }
+        t += tickMs;
+    }
+    out.durationMs = t;
+
+    // 曲线覆盖的每一分钟都应有一次设定值更新
+    int first = points[0].time;
+    int last = points[eventLimit - 1].time;
+    for (int m = first; m < last && m < ANALYSIS_MAX_MINUTES; m++) {
+        if (m < 0) continue;
+        if (!(covered[m / 8] & (1 << (m % 8)))) {
+            analysisMarkMinute(out.dropped, out.droppedCount, m);
+        }
+    }
+    return true;
+}
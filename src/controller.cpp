@@ -0,0 +1,1128 @@
+#include "controller.h"
+
+#include <ArduinoJson.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// 当前状态，初始为等待连接
+volatile LEDState currentState = WAITING_FOR_CONNECTION;
+
+volatile bool startSettingRequested = false; // 长按或 start_run 请求执行设定值，由 controllerLoop() 处理，避免与 tempEvent() 并发改写曲线状态
+
+int addr = 0;
+
+//温度段数组
+int newData[MAX_TEMPERATURE_POINTS][2];  // 原始数据数组
+int loadData[MAX_TEMPERATURE_POINTS][2]; // 用于加载数据的数组
+
+//计时相关变量
+unsigned long startTime = 0; // 存储计时开始或重置的时间点
+unsigned long currentTime = 0; // 存储当前时间
+unsigned long lastPrintTime = 0; // 上一次打印时间
+int currentEvent = 0; // 当前检查的事件索引
+
+// 定义一个全局变量，用于跟踪上一次插值的时间（插值间隔 INTERPOLATION_INTERVAL_MINUTES 见 controller_config.h）
+unsigned long lastInterpolationTime = 0;
+
+
+// 轮询广播设置
+unsigned long previousMillis = 0; // 保存上次发送状态的时间
+const long interval = 5000; // 默认心跳间隔（毫秒），状态无变化时也按此间隔发送
+
+// 状态订阅设置：状态变化时按最大速率推送，否则只在心跳到期时推送
+const unsigned long STATUS_MIN_RATE_LIMIT = 200;    // 客户端可请求的最小推送间隔（毫秒）
+const unsigned long STATUS_MAX_HEARTBEAT = 60000;   // 客户端可请求的最大心跳间隔（毫秒）
+const uint8_t STATUS_FIELD_RUNTIME = 0x01;             // 运行时间（分钟）
+const uint8_t STATUS_FIELD_RUNTIME_S = 0x02;           // 运行时间（秒）
+const uint8_t STATUS_FIELD_CURRENT_TEMPERATURE = 0x04; // 当前设定温度
+const uint8_t STATUS_FIELD_STATE = 0x08;               // 运行状态
+const uint8_t STATUS_FIELD_SEGMENT = 0x10;             // 当前温控段
+const uint8_t STATUS_FIELD_ALL = 0x1F;
+unsigned long statusMinInterval = 1000;   // 两次推送的最小间隔（毫秒）
+unsigned long statusHeartbeat = interval; // 心跳间隔（毫秒）
+uint8_t statusFields = STATUS_FIELD_RUNTIME | STATUS_FIELD_CURRENT_TEMPERATURE; // 默认字段与旧版一致
+bool statusDirty = true;     // 强制下一次推送（例如刚连接或订阅变更）
+int lastSentTemp = -1;       // 上次推送的设定温度
+int lastSentState = -1;      // 上次推送的运行状态
+int lastSentSegment = -1;    // 上次推送的温控段
+char statusBuffer[256];      // 状态推送复用的序列化缓冲区
+
+// 轮询温度设置
+unsigned long tempPreviousMillis = 0; // 保存上次发送状态的时间（更新间隔 TEMP_EVENT_INTERVAL_MS 见 controller_config.h）
+
+// 标志位设置
+bool isStart = 0;    // 是否已经启动
+bool isInterpolated = 0; // 当前是否被插值
+
+const size_t BATCH_REPLY_MAX_LENGTH = 512; // 批量汇总响应的最大长度，超出时改为只含结果码的精简响应
+const int BATCH_CODES_PER_REPLY = 64;      // 精简响应每条通知携带的结果码数
+// 精简响应文档容量：command、status、offset、total、codes、items、truncated 七个成员 + 两组序号
+const size_t BATCH_COMPACT_CAPACITY = JSON_OBJECT_SIZE(7) + 2 * JSON_ARRAY_SIZE(BATCH_CODES_PER_REPLY);
+const size_t BATCH_ITEM_CAPACITY = 2048;   // 单条批量结果的文档容量，足以容纳 15 个温控点或一块轨迹
+const size_t NOTIFY_MAX_LENGTH = 600;      // 单条响应的最大长度，超出时不发送
+
+// OTA 切换分区后的重启
+const unsigned long OTA_RESTART_DELAY = 1000;   // 切换分区后重启前的等待（毫秒）
+unsigned long otaRestartAt = 0;                 // 非 0 时在 controllerLoop() 中到期重启
+
+// 命令轨迹缓冲区（记录格式见 controller.h）
+uint8_t traceBuffer[TRACE_BUFFER_SIZE];
+volatile int traceLength = 0;           // 已录制的字节数
+volatile bool traceRecording = false;   // 是否正在录制
+volatile bool traceTruncated = false;   // 是否因缓冲区写满而丢弃过记录
+unsigned long traceStartMillis = 0;     // 录制开始时间
+
+// 全局变量
+bool deviceConnected = false;
+bool isRunning = false;
+bool hasSentTemperaturePoints = false;
+int NowTemp =0;  // 插入的值
+
+// 全局函数声明
+void sendTemperaturePoints();
+void fillTemperaturePoints(JsonArray data);
+void setTemp(int a);
+void sendStatusIfNeeded();
+CommandStatus dispatchCommand(JsonObject cmd, bool notify, JsonObject result);
+
+
+
+// 序列化后通过通知发送
+void notifyJson(JsonDocument &doc) {
+    std::vector<char> buffer(measureJson(doc) + 1);
+    size_t len = serializeJson(doc, buffer.data(), buffer.size());
+    platformNotify((const uint8_t*)buffer.data(), len);
+}
+
+// LFF 的屎山函数
+// 执行设定值
+void executeSetting() {
+    // 从EEPROM读取数据
+    int addr = 0;
+
+    for (int i = 0; i < MAX_TEMPERATURE_POINTS; i++) {
+        // 读取时间（2字节）
+        uint8_t timeLow = platformStorageRead(addr);
+        uint8_t timeHigh = platformStorageRead(addr + 1);
+        int time = (timeHigh << 8) | timeLow;
+
+        // 读取温度（2字节）
+        uint8_t tempLow = platformStorageRead(addr + 2);
+        uint8_t tempHigh = platformStorageRead(addr + 3);
+        int temperature = (tempHigh << 8) | tempLow;
+
+        // 更新地址到下一个温控点
+        addr += BYTES_PER_POINT;
+
+        // 检查时间是否有效并存储到 loadData
+        if (time >= 0 && time < 1000) { // 假设时间在0到1000分钟之间有效
+            loadData[i][0] = time;       // 第0列存储时间
+            loadData[i][1] = temperature; // 第1列存储温度
+
+            platformLog("温控点 %d - 时间: %d 分钟, 温度: %d°C\n", i + 1, time, temperature);
+        } else {
+            // 如果时间无效，标记为默认值或跳过
+            loadData[i][0] = 114514; // 标记时间无效
+            loadData[i][1] = 114514; // 标记温度无效
+
+            platformLog("温控点 %d - 未设置或无效的数据，跳过\n", i + 1);
+        }
+        isStart = 1;
+    }
+
+    // 打印设定值数组
+    platformLog("\n设定值：\n");
+    for (int i = 0; i < MAX_TEMPERATURE_POINTS; i++) {
+        // 检查当前行是否已经是默认的0值，如果是，则不打印后续的数据
+        if (loadData[i][0] == 114514 && loadData[i][1] == 114514) break;
+
+        platformLog("温度点%d：%d分钟 %d度\n", i + 1, loadData[i][0], loadData[i][1]);
+    }
+
+    startTime = platformMillis(); // 重置开始时间
+    currentEvent = 0;
+    isStart = 1;
+}
+
+// 重置设定值
+void resetSetting() {
+  uint8_t value = 0xff;
+  platformLog("开始重置 EEPROM，设置所有字节为: 0x%X\n", value);
+
+  for (int addr = 0; addr < EEPROM_SIZE; addr++) {
+    platformStorageWrite(addr, value);
+  }
+
+  // 确保数据写入 EEPROM
+  if (platformStorageCommit()) {
+    platformLog("EEPROM 重置成功！\n");
+  } else {
+    platformLog("EEPROM 重置失败！\n");
+  }
+}
+
+void tempEvent() {
+  if (currentEvent < MAX_TEMPERATURE_POINTS - 1 && loadData[currentEvent][0] != 114514) { // 确保至少还有一个后续事件
+    unsigned long currentTime = (platformMillis() - startTime) / 1000 / 60; // 计算当前时间（分钟）
+
+    // 当时间达到当前事件指定的时间时
+    if (currentTime >= loadData[currentEvent][0]) {
+      // 设置初始温度
+      setTemp(loadData[currentEvent][1]);
+      platformLog("温度已经设定为: %d\n", loadData[currentEvent][1]);
+
+      // 准备开始插值到下一个事件的温度
+      currentEvent++;
+      lastInterpolationTime = currentTime; // 重置插值时间
+      // isInterpolated = 0;
+    }
+    else if (currentTime - lastInterpolationTime >= INTERPOLATION_INTERVAL_MINUTES && currentEvent > 0) {
+      // 插值计算
+      float timeDiff = loadData[currentEvent][0] - loadData[currentEvent - 1][0];
+      if (timeDiff > 0) {
+        float tempDiff = loadData[currentEvent][1] - loadData[currentEvent - 1][1];
+        float fraction = (currentTime - loadData[currentEvent - 1][0]) / timeDiff;
+        int interpolatedTemp = loadData[currentEvent - 1][1] + round(tempDiff * fraction);
+
+        // 更新温度
+        setTemp(interpolatedTemp);
+        platformLog("插值温度更新为: %d\n", interpolatedTemp);
+      }
+      lastInterpolationTime = currentTime; // 更新插值时间
+      // isInterpolated = 1;
+    }
+    currentState = EXECUTING;
+  }else if (isStart){
+    currentState = COMPLETED ;
+  }
+}
+
+
+// 打印时间戳
+void printTime() {
+  currentTime = platformMillis(); // 获取当前时间点
+
+  if (currentTime - lastPrintTime >= 10000) { // 每隔至少1000毫秒更新一次
+
+    lastPrintTime = currentTime; // 更新上一次打印时间
+
+    unsigned long elapsed = currentTime - startTime; // 计算经过的时间
+    unsigned long seconds = elapsed / 1000; // 总秒数
+    unsigned long minutes = seconds / 60; // 总分钟数
+    unsigned long hours = minutes / 60; // 总小时数
+    unsigned long days = hours / 24; // 总天数
+
+    // 计算剩余的小时、分钟和秒
+    hours = hours % 24;
+    minutes = minutes % 60;
+    seconds = seconds % 60;
+
+    // 打印当前运行时间
+    platformLog("程序已运行 %lu 天 %lu 小时 %lu 分 %lu 秒\n", days, hours, minutes, seconds);
+    platformDelay(10);
+  }
+}
+
+// 按下并松开一次温控器按键
+void pressKey(int key, int holdMs) {
+  platformKeyWrite(key, true);platformDelay(holdMs);platformKeyWrite(key, false);platformDelay(holdMs);
+}
+
+// 设置温控器温度为0
+void setTempZero(){
+  // KEY1按一次
+  pressKey(KEY1, KEY_CONFIRM_HOLD_MS);
+
+  // KEY4按3次
+  for (int i = 0; i < 3; i++) {
+    pressKey(KEY4, KEY_STEP_HOLD_MS);
+  }
+
+  // KEY2按2次
+  for (int i = 0; i < 2; i++) {
+    pressKey(KEY2, KEY_STEP_HOLD_MS);
+  }
+
+  // KEY1按一次
+  pressKey(KEY1, KEY_CONFIRM_HOLD_MS);
+}
+
+// 设置温控器温度
+void setTemp(int a) {
+  NowTemp = a;
+  setTempZero();    // 设置温度为零
+
+  // KEY1按一次,表示启动
+  pressKey(KEY1, KEY_CONFIRM_HOLD_MS);
+
+  // 获取三位数的个位数
+  int units = a % 10;
+  // 让KEY3闪烁units次
+  for (int i = 0; i < units; i++) {
+    pressKey(KEY3, KEY_STEP_HOLD_MS);
+  }
+
+  // KEY4按一次,表示前移一位
+  pressKey(KEY4, KEY_STEP_HOLD_MS);
+
+  // 获取三位数的十位数
+  int tens = (a / 10) % 10;
+  // 让KEY3闪烁tens次
+  for (int i = 0; i < tens; i++) {
+    pressKey(KEY3, KEY_STEP_HOLD_MS);
+  }
+
+  // KEY4按一次,表示前移一位
+  pressKey(KEY4, KEY_STEP_HOLD_MS);
+
+  // 获取三位数的百位数
+  int hundreds = a / 100;
+  // 让KEY3闪烁hundreds次
+  for (int i = 0; i < hundreds; i++) {
+    pressKey(KEY3, KEY_STEP_HOLD_MS);
+  }
+
+  // KEY1按一次,表示结束
+  pressKey(KEY1, KEY_CONFIRM_HOLD_MS);
+}
+
+
+
+// 追加一条轨迹记录，未录制时直接返回
+void traceRecord(TraceRecordType type, const uint8_t *data, size_t length) {
+    if (!traceRecording) return;
+
+    uint32_t timestamp = platformMillis() - traceStartMillis;
+    platformLock();
+    if (traceLength + TRACE_RECORD_HEADER + (int)length > TRACE_BUFFER_SIZE || length > 0xFFFF) {
+        traceTruncated = true;
+        traceRecording = false;
+    } else {
+        uint8_t *p = traceBuffer + traceLength;
+        p[0] = timestamp & 0xFF;
+        p[1] = (timestamp >> 8) & 0xFF;
+        p[2] = (timestamp >> 16) & 0xFF;
+        p[3] = (timestamp >> 24) & 0xFF;
+        p[4] = type;
+        p[5] = length & 0xFF;
+        p[6] = (length >> 8) & 0xFF;
+        if (length > 0) memcpy(p + TRACE_RECORD_HEADER, data, length);
+        traceLength += TRACE_RECORD_HEADER + length;
+    }
+    platformUnlock();
+}
+
+// 小端读写，快照使用
+void putLE(uint8_t *p, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+uint32_t getLE(const uint8_t *p, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint32_t)p[i] << (8 * i);
+    return value;
+}
+
+// 开始录制，第一条记录为当前状态快照，回放时据此恢复设备状态（格式见 controller.h）
+void traceStart() {
+    platformLock();
+    traceLength = 0;
+    traceTruncated = false;
+    traceStartMillis = platformMillis();
+    traceRecording = true;
+    platformUnlock();
+
+    static uint8_t snapshot[TRACE_SNAPSHOT_SIZE];
+    for (int i = 0; i < EEPROM_SIZE; i++) {
+        snapshot[i] = platformStorageRead(i);
+    }
+    unsigned long now = platformMillis();
+    uint8_t *p = snapshot + EEPROM_SIZE;
+    p[0] = (isStart ? 0x01 : 0) | (isRunning ? 0x02 : 0) | (deviceConnected ? 0x04 : 0);
+    p[1] = currentEvent;
+    putLE(p + 2, now - startTime, 4);
+    putLE(p + 6, lastInterpolationTime, 4);
+    putLE(p + 10, now - tempPreviousMillis, 4);
+    putLE(p + 14, NowTemp, 2);
+    p[16] = currentState;
+    p[17] = statusFields;
+    putLE(p + 18, statusMinInterval, 2);
+    putLE(p + 20, statusHeartbeat, 2);
+    putLE(p + 22, now - previousMillis, 4);
+    traceRecord(TRACE_SNAPSHOT, snapshot, sizeof(snapshot));
+}
+
+// 恢复快照：写回 EEPROM，曲线已启动时重新加载温控点，再覆盖运行时状态
+bool restoreSnapshot(const uint8_t *data, size_t length) {
+    if (length != TRACE_SNAPSHOT_SIZE) return false;
+
+    for (int i = 0; i < EEPROM_SIZE; i++) {
+        platformStorageWrite(i, data[i]);
+    }
+    platformStorageCommit();
+
+    const uint8_t *p = data + EEPROM_SIZE;
+    unsigned long now = platformMillis();
+    isStart = p[0] & 0x01;
+    if (isStart) executeSetting();
+    isRunning = p[0] & 0x02;
+    deviceConnected = p[0] & 0x04;
+    hasSentTemperaturePoints = deviceConnected;
+    startSettingRequested = false;
+    currentEvent = p[1];
+    startTime = now - getLE(p + 2, 4);
+    lastInterpolationTime = getLE(p + 6, 4);
+    tempPreviousMillis = now - getLE(p + 10, 4);
+    NowTemp = getLE(p + 14, 2);
+    currentState = (LEDState)p[16];
+    statusFields = p[17];
+    statusMinInterval = getLE(p + 18, 2);
+    statusHeartbeat = getLE(p + 20, 2);
+    previousMillis = now - getLE(p + 22, 4);
+    // 视为上次推送的就是当前状态，下一次推送按心跳或状态变化触发
+    statusDirty = false;
+    lastSentTemp = isStart ? NowTemp : 0;
+    lastSentState = currentState;
+    lastSentSegment = isStart ? currentEvent : -1;
+    return true;
+}
+
+// 导出 [offset, offset + TRACE_DUMP_CHUNK) 范围内的轨迹，数据为十六进制字符串
+void fillTraceChunk(JsonObject data, int offset) {
+    static char hex[TRACE_DUMP_CHUNK * 2 + 1];
+
+    int total = traceLength;
+    if (offset < 0) offset = 0;
+    if (offset > total) offset = total;
+    int length = std::min(TRACE_DUMP_CHUNK, total - offset);
+    for (int i = 0; i < length; i++) {
+        sprintf(hex + i * 2, "%02x", traceBuffer[offset + i]);
+    }
+    hex[length * 2] = '\0';
+
+    data["offset"] = offset;
+    data["total"] = total;
+    data["recording"] = (bool)traceRecording;
+    data["truncated"] = (bool)traceTruncated;
+    data["data"] = (char*)hex; // 复制字符串，批量中多个 trace_dump 不会共用同一缓冲区
+}
+
+CommandStatus toCommandStatus(OtaResult result) {
+    switch (result) {
+        case OTA_OK:          return CMD_OK;
+        case OTA_BAD_REQUEST: return CMD_BAD_REQUEST;
+        default:              return CMD_INVALID_STATE;
+    }
+}
+
+void fillOtaStatus(JsonObject data) {
+    data["state"] = ota.stateName();
+    data["offset"] = ota.offset();
+    data["size"] = ota.size();
+    data["window"] = ota.window();
+    data["elapsed_ms"] = ota.elapsedMs();
+    data["bytes_per_s"] = ota.throughput();
+}
+
+void sendOtaStatus(const char* status) {
+    DynamicJsonDocument response(256);
+    response["command"] = "ota_status";
+    response["status"] = status;
+    fillOtaStatus(response.createNestedObject("data"));
+    notifyJson(response);
+}
+
+// 开始或续传：{"size": N, "sha256": "hex", "window": 4096}
+CommandStatus otaBegin(JsonObject data) {
+    bool resume = ota.state() == OTA_RECEIVING;
+    uint32_t size = data["size"] | 0;
+    const char* sha = data["sha256"];
+    uint32_t window = data["window"] | OTA_DEFAULT_WINDOW;
+    OtaResult result = ota.begin(size, sha, window);
+    if (result == OTA_OK && resume && ota.offset() > 0) {
+        platformLog("OTA 续传，偏移 %u\n", (unsigned)ota.offset());
+    }
+    return toCommandStatus(result);
+}
+
+// 校验并切换分区；温控曲线运行中只校验，不切换
+CommandStatus otaEnd() {
+    OtaResult result = ota.end(isStart || isRunning);
+    if (ota.state() == OTA_FAILED) {
+        platformLog("OTA 校验失败\n");
+    } else if (result == OTA_OK) {
+        platformLog("OTA 校验通过，%u 字节，%u 字节/秒，即将重启\n", (unsigned)ota.size(), (unsigned)ota.throughput());
+        otaRestartAt = platformMillis();
+    } else if (ota.state() == OTA_VERIFIED) {
+        platformLog("温控曲线运行中，暂不切换分区\n");
+    }
+    return toCommandStatus(result);
+}
+
+void handleConnect() {
+  traceRecord(TRACE_CONNECT, NULL, 0);
+  deviceConnected = true;
+  platformLog("设备已连接\n");
+  if(isStart){
+    currentState = EXECUTING;
+  }else{
+    currentState = CONNECTION_SUCCESS;
+  }
+
+  hasSentTemperaturePoints = false; // 重置标志位，以便发送温控点
+  // 新连接恢复默认订阅，并立即推送一次状态
+  statusMinInterval = 1000;
+  statusHeartbeat = interval;
+  statusFields = STATUS_FIELD_RUNTIME | STATUS_FIELD_CURRENT_TEMPERATURE;
+  statusDirty = true;
+}
+
+void handleDisconnect() {
+  traceRecord(TRACE_DISCONNECT, NULL, 0);
+  deviceConnected = false;
+  platformLog("设备已断开连接\n");
+  // isRunning = false; // 停止运行
+  if(isRunning){
+    currentState = EXECUTING_WITHOUT_CONECT;
+  }else{
+    currentState = WAITING_FOR_CONNECTION;
+  }
+}
+
+void sendRunStatus(const char* status) {
+  char message[64];
+  snprintf(message, sizeof(message), "运行状态: %s", status);
+
+  DynamicJsonDocument response(256);
+  response["command"] = "run_status";
+  response["status"] = status;
+  response["message"] = (char*)message;
+
+  if (measureJson(response) <= NOTIFY_MAX_LENGTH) {
+    platformDelay(300); // 确保客户端有足够时间处理数据
+    notifyJson(response);
+    platformLog("已发送运行状态: %s\n", status);
+  } else {
+    platformLog("响应数据过大，未发送\n");
+  }
+}
+
+// 批量命令：[{"command": ...}, {"command": ...}]
+// 汇总响应：{"command": "batch_result", "status": "success"|"partial", "results": [{"command": ..., "code": 0}, ...]}
+// 汇总响应超过 BATCH_REPLY_MAX_LENGTH 时改为精简响应，按 BATCH_CODES_PER_REPLY 条一组分多次通知：
+// {"command": "batch_result", "status": ..., "offset": 0, "total": N, "codes": [0, 1, ...], "items": 1, "truncated": [...]}
+// 带数据的结果（get_temperature_points、trace_dump、analyze_profile 等）在所属分组之前单独通知：
+// {"command": "batch_item", "index": i, "result": {"command": ..., "code": 0, ...}}
+// items 为该分组单独通知的结果数，truncated 为超过 NOTIFY_MAX_LENGTH 而未能发送数据的结果序号
+void handleBatch(JsonArray commands) {
+  DynamicJsonDocument response(4096);
+  response["command"] = "batch_result";
+  JsonArray results = response.createNestedArray("results");
+
+  std::vector<uint8_t> codes;
+  std::vector<int> detailIndexes;        // 带数据的结果序号
+  std::vector<std::string> details;      // 对应的序列化结果
+  std::vector<int> truncated;            // 数据超出文档容量的结果序号
+  bool allOk = true;
+  for (JsonVariant item : commands) {
+    int index = codes.size();
+    DynamicJsonDocument itemDoc(BATCH_ITEM_CAPACITY);
+    JsonObject result = itemDoc.to<JsonObject>();
+    result["command"] = item["command"];
+    CommandStatus code = item.is<JsonObject>()
+                           ? dispatchCommand(item.as<JsonObject>(), false, result)
+                           : CMD_BAD_REQUEST;
+    result["code"] = (int)code;
+    if (code != CMD_OK) allOk = false;
+    codes.push_back(code);
+
+    if (itemDoc.overflowed()) {
+      truncated.push_back(index);
+    } else if (result.size() > 2) {
+      std::vector<char> buffer(measureJson(itemDoc) + 1);
+      serializeJson(itemDoc, buffer.data(), buffer.size());
+      detailIndexes.push_back(index);
+      details.push_back(buffer.data());
+    }
+    results.add(result);
+  }
+  const char* status = allOk ? "success" : "partial";
+  response["status"] = status;
+  platformLog("批量命令执行完成，共 %d 条\n", (int)codes.size());
+
+  if (truncated.empty() && !response.overflowed() && measureJson(response) <= BATCH_REPLY_MAX_LENGTH) {
+    notifyJson(response);
+    return;
+  }
+
+  // 完整结果放不下，带数据的结果单独发送，汇总只发结果码，保证客户端总能知道每条命令的执行结果
+  platformLog("批量响应过大，改为发送精简响应\n");
+  int total = codes.size();
+  int offset = 0;
+  size_t detail = 0;
+  size_t cut = 0;
+  do {
+    int end = std::min(total, offset + BATCH_CODES_PER_REPLY);
+
+    int items = 0;
+    std::vector<int> chunkTruncated;
+    for (; cut < truncated.size() && truncated[cut] < end; cut++) {
+      chunkTruncated.push_back(truncated[cut]);
+    }
+    for (; detail < detailIndexes.size() && detailIndexes[detail] < end; detail++) {
+      std::string message = "{\"command\":\"batch_item\",\"index\":" + std::to_string(detailIndexes[detail]) +
+                            ",\"result\":" + details[detail] + "}";
+      if (message.size() > NOTIFY_MAX_LENGTH) {
+        chunkTruncated.push_back(detailIndexes[detail]);
+        continue;
+      }
+      platformNotify((const uint8_t*)message.data(), message.size());
+      items++;
+    }
+
+    DynamicJsonDocument compact(BATCH_COMPACT_CAPACITY);
+    compact["command"] = "batch_result";
+    compact["status"] = status;
+    compact["offset"] = offset;
+    compact["total"] = total;
+    JsonArray compactCodes = compact.createNestedArray("codes");
+    for (int i = offset; i < end; i++) {
+      compactCodes.add(codes[i]);
+    }
+    compact["items"] = items;
+    if (!chunkTruncated.empty()) {
+      std::sort(chunkTruncated.begin(), chunkTruncated.end());
+      JsonArray cutIndexes = compact.createNestedArray("truncated");
+      for (int index : chunkTruncated) cutIndexes.add(index);
+      platformLog("批量结果 %d 条数据过大，未发送\n", (int)chunkTruncated.size());
+    }
+    notifyJson(compact);
+    offset += BATCH_CODES_PER_REPLY;
+  } while (offset < total);
+}
+
+CommandStatus handleSetTemperaturePoints(JsonArray data, bool notify) {
+  if (data.isNull()) {
+    platformLog("温控点数据格式错误\n");
+    return CMD_BAD_REQUEST;
+  }
+
+  // 将温控点数据写入EEPROM
+  platformLog("设置温控点数据\n");
+  int index = 0;
+
+  // 遍历 JSON 数据并写入温控点
+  for (JsonObject point : data) {
+      if (index >= MAX_TEMPERATURE_POINTS) break;
+      int time = point["time"];
+      int temperature = point["temperature"];
+      int addr = index * BYTES_PER_POINT;
+
+      platformStorageWrite(addr, time & 0xFF);            // 时间低字节
+      platformStorageWrite(addr + 1, (time >> 8) & 0xFF); // 时间高字节
+      platformStorageWrite(addr + 2, temperature & 0xFF); // 温度低字节
+      platformStorageWrite(addr + 3, (temperature >> 8) & 0xFF); // 温度高字节
+
+      platformLog("温控点 %d - 时间: %d 分钟, 温度: %d°C\n", index + 1, time, temperature);
+      index++;
+  }
+
+  // 填充剩余的区域为 0xFF
+  for (int i = index; i < MAX_TEMPERATURE_POINTS; i++) {
+      int addr = i * BYTES_PER_POINT;
+      for (int j = 0; j < BYTES_PER_POINT; j++) {
+          platformStorageWrite(addr + j, 0xFF);
+      }
+  }
+
+  platformStorageCommit(); // 保存更改
+  platformLog("温控点数据已保存到EEPROM\n");
+
+  isStart = 0;
+  currentState = RECEIVING_SUCCESS;
+  if (!notify) return CMD_OK;
+
+  // 发送验证结果
+  DynamicJsonDocument response(256);
+  response["command"] = "verify_temperature_points";
+  response["status"] = "success";
+  response["message"] = "温控点设置成功";
+
+  if (measureJson(response) <= NOTIFY_MAX_LENGTH) {
+    platformDelay(300); // 确保客户端有足够时间处理数据
+    notifyJson(response);
+    platformLog("温控点验证通过，已发送响应\n");
+  } else {
+    platformLog("响应数据过大，未发送\n");
+  }
+  return CMD_OK;
+}
+
+CommandStatus handleStartRun(bool notify) {
+  if (!isRunning) {
+    isRunning = true;
+    platformLog("开始运行\n");
+    if (notify) sendRunStatus("started");
+    // 启动LED闪烁任务
+    currentState = EXECUTING;
+  }
+  // BLE 任务优先级高于主循环，不能在这里直接重置曲线状态
+  startSettingRequested = true;
+  return CMD_OK;
+}
+
+CommandStatus handleInterrupt(bool notify) {
+  if (!isRunning) {
+    return CMD_INVALID_STATE;
+  }
+  isRunning = false;
+  platformLog("运行已中断\n");
+  if (notify) sendRunStatus("interrupted");
+  currentState = CONNECTION_SUCCESS;   //  LED
+  isStart = 0;
+  startSettingRequested = false;       // 尚未开始的运行一并取消
+  return CMD_OK;
+}
+
+CommandStatus handleOta(const char* command, JsonObject data, bool notify, JsonObject result) {
+  CommandStatus code = CMD_OK;
+  if (strcmp(command, "ota_status") != 0 && !platformLinkSecure()) {
+    // 固件只能通过加密链路写入，客户端配对完成后重试
+    platformLog("OTA 需要加密连接，已请求配对\n");
+    code = CMD_INVALID_STATE;
+  } else if (strcmp(command, "ota_begin") == 0) {
+    code = otaBegin(data);
+  } else if (strcmp(command, "ota_end") == 0) {
+    code = otaEnd();
+  } else if (strcmp(command, "ota_abort") == 0) {
+    ota.abort();
+  }
+
+  if (notify) {
+    sendOtaStatus(code == CMD_OK ? "success" : "error");
+  } else {
+    fillOtaStatus(result);
+  }
+  return code;
+}
+
+// trace_start 清空并开始录制，trace_stop 停止录制，
+// trace_dump {"offset": N} 分块导出，客户端按 total 循环拉取
+CommandStatus handleTrace(const char* command, JsonObject data, bool notify, JsonObject result) {
+  int offset = 0;
+  if (strcmp(command, "trace_start") == 0) {
+    traceStart();
+    platformLog("开始录制命令轨迹\n");
+  } else if (strcmp(command, "trace_stop") == 0) {
+    traceRecording = false;
+    platformLog("停止录制命令轨迹，共 %d 字节\n", traceLength);
+  } else {
+    offset = data["offset"] | 0;
+  }
+
+  if (!notify) {
+    fillTraceChunk(result, offset);
+    return CMD_OK;
+  }
+
+  DynamicJsonDocument response(768);
+  response["command"] = "trace_chunk";
+  fillTraceChunk(response.createNestedObject("data"), offset);
+  notifyJson(response);
+  return CMD_OK;
+}
+
+// 分析温控曲线的按键代价：data 与 set_temperature_points 格式相同，缺省时分析 EEPROM 中的曲线
+CommandStatus handleAnalyzeProfile(JsonArray data, bool notify, JsonObject result) {
+  ProfilePoint points[MAX_TEMPERATURE_POINTS];
+  int count = 0;
+
+  if (!data.isNull()) {
+    for (JsonObject point : data) {
+      if (count >= MAX_TEMPERATURE_POINTS) break;
+      points[count].time = point["time"];
+      points[count].temperature = point["temperature"];
+      if (!profilePointValid(points[count])) {
+        platformLog("温控点 %d 无效，拒绝分析\n", count + 1);
+        return CMD_BAD_REQUEST;
+      }
+      count++;
+    }
+  } else {
+    for (int i = 0; i < MAX_TEMPERATURE_POINTS; i++) {
+      int addr = i * BYTES_PER_POINT;
+      int time = platformStorageRead(addr) | (platformStorageRead(addr + 1) << 8);
+      int temperature = platformStorageRead(addr + 2) | (platformStorageRead(addr + 3) << 8);
+      if (time < 0 || time >= 1000) break;
+      points[count].time = time;
+      points[count].temperature = temperature;
+      count++;
+    }
+  }
+  if (count == 0) {
+    return CMD_BAD_REQUEST;
+  }
+
+  // tempEvent() 不会执行最后一个温控点位置
+  ProfileAnalysis analysis;
+  if (!analyzeProfile(points, count, std::min(count, MAX_TEMPERATURE_POINTS - 1),
+                      TEMP_EVENT_INTERVAL_MS, INTERPOLATION_INTERVAL_MINUTES, 2 * TEMP_EVENT_INTERVAL_MS, analysis)) {
+    return CMD_BAD_REQUEST;
+  }
+  platformLog("曲线分析: 按键 %u 次, 阻塞 %u ms, 最大延迟 %u ms\n",
+              (unsigned)analysis.presses, (unsigned)analysis.blockedMs, (unsigned)analysis.worstLagMs);
+
+  DynamicJsonDocument response(768);
+  JsonObject out = notify ? response.createNestedObject("data") : result;
+  out["presses"] = analysis.presses;
+  out["updates"] = analysis.updates;
+  out["blocked_ms"] = analysis.blockedMs;
+  out["duration_ms"] = analysis.durationMs;
+  out["blocked_permille"] = analysis.durationMs ? (uint32_t)((uint64_t)analysis.blockedMs * 1000 / analysis.durationMs) : 0;
+  out["worst_lag_ms"] = analysis.worstLagMs;
+  out["worst_lag_minute"] = analysis.worstLagMinute;
+  out["max_error"] = analysis.maxError;
+  out["dropped_count"] = analysis.droppedCount;
+  out["delayed_count"] = analysis.delayedCount;
+  JsonArray dropped = out.createNestedArray("dropped");
+  for (int i = 0; i < std::min(analysis.droppedCount, ANALYSIS_MAX_REPORTED_MINUTES); i++) dropped.add(analysis.dropped[i]);
+  JsonArray delayed = out.createNestedArray("delayed");
+  for (int i = 0; i < std::min(analysis.delayedCount, ANALYSIS_MAX_REPORTED_MINUTES); i++) delayed.add(analysis.delayed[i]);
+
+  if (notify) {
+    response["command"] = "profile_analysis";
+    notifyJson(response);
+  }
+  return CMD_OK;
+}
+
+// 订阅状态推送：{"max_rate_ms": 1000, "heartbeat_ms": 5000, "fields": ["runtime", ...]}
+// 未给出的参数保持当前值，fields 为空或缺省时保持当前字段集
+void handleSubscribeStatus(JsonObject data) {
+  if (data.containsKey("max_rate_ms")) {
+    unsigned long rate = data["max_rate_ms"];
+    statusMinInterval = std::min(std::max(rate, STATUS_MIN_RATE_LIMIT), STATUS_MAX_HEARTBEAT);
+  }
+  if (data.containsKey("heartbeat_ms")) {
+    unsigned long heartbeat = data["heartbeat_ms"];
+    statusHeartbeat = std::min(std::max(heartbeat, statusMinInterval), STATUS_MAX_HEARTBEAT);
+  }
+  if (statusHeartbeat < statusMinInterval) {
+    statusHeartbeat = statusMinInterval;
+  }
+
+  JsonArray fields = data["fields"];
+  if (!fields.isNull() && fields.size() > 0) {
+    uint8_t mask = 0;
+    for (const char* field : fields) {
+      if (field == nullptr) continue;
+      if (strcmp(field, "runtime") == 0) mask |= STATUS_FIELD_RUNTIME;
+      else if (strcmp(field, "runtime_s") == 0) mask |= STATUS_FIELD_RUNTIME_S;
+      else if (strcmp(field, "current_temperature") == 0) mask |= STATUS_FIELD_CURRENT_TEMPERATURE;
+      else if (strcmp(field, "state") == 0) mask |= STATUS_FIELD_STATE;
+      else if (strcmp(field, "segment") == 0) mask |= STATUS_FIELD_SEGMENT;
+    }
+    if (mask != 0) {
+      statusFields = mask;
+    }
+  }
+
+  platformLog("状态订阅: 最小间隔 %lu ms, 心跳 %lu ms, 字段 0x%02X\n",
+              statusMinInterval, statusHeartbeat, statusFields);
+  statusDirty = true; // 订阅变更后立即按新格式推送
+}
+
+// 执行单条命令。notify 为 false 时（批量模式）不单独发送响应，
+// 需要返回的数据写入 result
+CommandStatus dispatchCommand(JsonObject cmd, bool notify, JsonObject result) {
+  const char* command = cmd["command"];
+  if (command == nullptr) {
+    platformLog("缺少命令名\n");
+    return CMD_BAD_REQUEST;
+  }
+
+  if (strcmp(command, "get_temperature_points") == 0) {
+    // 处理获取温控点的请求
+    if (notify) {
+      sendTemperaturePoints();
+    } else {
+      fillTemperaturePoints(result.createNestedArray("data"));
+    }
+    return CMD_OK;
+  } else if (strcmp(command, "set_temperature_points") == 0) {
+    // 处理设置温控点的请求
+    return handleSetTemperaturePoints(cmd["data"], notify);
+  } else if (strcmp(command, "start_run") == 0) {
+    // 处理开始运行的请求
+    return handleStartRun(notify);
+  } else if (strcmp(command, "interrupt") == 0) {
+    // 处理中断运行的请求
+    return handleInterrupt(notify);
+  } else if (strcmp(command, "subscribe_status") == 0) {
+    // 处理状态订阅请求
+    handleSubscribeStatus(cmd["data"]);
+    return CMD_OK;
+  } else if (strcmp(command, "ota_begin") == 0 || strcmp(command, "ota_end") == 0 ||
+             strcmp(command, "ota_abort") == 0 || strcmp(command, "ota_status") == 0) {
+    // 处理固件升级请求
+    return handleOta(command, cmd["data"], notify, result);
+  } else if (strcmp(command, "trace_start") == 0 || strcmp(command, "trace_stop") == 0 ||
+             strcmp(command, "trace_dump") == 0) {
+    // 处理轨迹录制请求
+    return handleTrace(command, cmd["data"], notify, result);
+  } else if (strcmp(command, "analyze_profile") == 0) {
+    // 处理温控曲线代价分析请求
+    return handleAnalyzeProfile(cmd["data"], notify, result);
+  }
+  // 处理其他命令
+  platformLog("未知命令: %s\n", command);
+  return CMD_UNKNOWN;
+}
+
+void handleWrite(const uint8_t *data, size_t length) {
+  if (length == 0) return;
+
+  traceRecord(TRACE_COMMAND, data, length);
+  unsigned long commandStart = platformMicros();
+
+  platformLog("收到数据:\n%.*s\n", (int)length, (const char*)data);
+
+  // 解析JSON
+  DynamicJsonDocument doc(20480);
+  DeserializationError error = deserializeJson(doc, (const char*)data, length);
+  if (error) {
+    platformLog("JSON解析失败: %s\n", error.c_str());
+  } else if (doc.is<JsonArray>()) {
+    // 批量命令：按顺序执行，只发送一次汇总响应
+    handleBatch(doc.as<JsonArray>());
+  } else {
+    dispatchCommand(doc.as<JsonObject>(), true, JsonObject());
+  }
+
+  uint32_t elapsed = platformMicros() - commandStart;
+  traceRecord(TRACE_COMMAND_DONE, (const uint8_t*)&elapsed, sizeof(elapsed));
+}
+
+// 全局函数定义
+// 从EEPROM读取温控点数据并写入 JSON 数组
+void fillTemperaturePoints(JsonArray data) {
+    platformLog("读取EEPROM中的温控点数据:\n");
+    for (int i = 0; i < MAX_TEMPERATURE_POINTS; i++) {
+        int addr = i * BYTES_PER_POINT;
+        uint8_t timeLow = platformStorageRead(addr);
+        uint8_t timeHigh = platformStorageRead(addr + 1);
+        uint8_t tempLow = platformStorageRead(addr + 2);
+        uint8_t tempHigh = platformStorageRead(addr + 3);
+
+        int time = (timeHigh << 8) | timeLow;
+        int temperature = (tempHigh << 8) | tempLow;
+
+        // 排除时间为0或65535的温控点
+        if (time >= 0 && time < 1000) { // 假设时间不会超过1000分钟
+            JsonObject point = data.createNestedObject();
+            point["time"] = time;
+            point["temperature"] = temperature;
+            platformLog("温控点 %d - 时间: %d 分钟, 温度: %d°C\n", i + 1, time, temperature);
+        } else {
+            platformLog("温控点 %d - 未设置或无效的数据，跳过\n", i + 1);
+        }
+    }
+}
+
+void sendTemperaturePoints() {
+    DynamicJsonDocument response(2048);
+    response["command"] = "temperature_points";
+    fillTemperaturePoints(response.createNestedArray("data"));
+
+    if (measureJson(response) <= NOTIFY_MAX_LENGTH) {
+        platformDelay(777); // 确保客户端有足够时间处理数据
+        notifyJson(response);
+        platformLog("已发送温控点数据\n");
+    } else {
+        platformLog("响应数据过大，未发送\n");
+    }
+}
+
+// 按订阅推送当前状态：设定温度、运行状态或温控段变化时按最大速率推送，否则只发心跳
+void sendStatusIfNeeded() {
+    static StaticJsonDocument<256> statusDoc;
+
+    unsigned long currentMillis = platformMillis();
+    unsigned long sinceLast = currentMillis - previousMillis;
+
+    int temp = isStart ? NowTemp : 0;
+    int state = currentState;
+    int segment = isStart ? currentEvent : -1;
+    // 只有订阅了的字段变化才触发推送
+    bool changed = statusDirty ||
+                   ((statusFields & STATUS_FIELD_CURRENT_TEMPERATURE) && temp != lastSentTemp) ||
+                   ((statusFields & STATUS_FIELD_STATE) && state != lastSentState) ||
+                   ((statusFields & STATUS_FIELD_SEGMENT) && segment != lastSentSegment);
+
+    if (changed ? (!statusDirty && sinceLast < statusMinInterval) : (sinceLast < statusHeartbeat)) {
+      return;
+    }
+
+    unsigned long elapsed = isStart ? currentMillis - startTime : 0;
+
+    statusDoc.clear();
+    statusDoc["command"] = "current_status";
+    JsonObject data = statusDoc.createNestedObject("data");
+    if (statusFields & STATUS_FIELD_RUNTIME) data["runtime"] = elapsed / 60000;
+    if (statusFields & STATUS_FIELD_RUNTIME_S) data["runtime_s"] = elapsed / 1000;
+    if (statusFields & STATUS_FIELD_CURRENT_TEMPERATURE) data["current_temperature"] = temp;
+    if (statusFields & STATUS_FIELD_STATE) data["state"] = state;
+    if (statusFields & STATUS_FIELD_SEGMENT) data["segment"] = segment;
+
+    size_t len = serializeJson(statusDoc, statusBuffer, sizeof(statusBuffer));
+    if (len > 0 && len < sizeof(statusBuffer)) {
+      platformNotify((const uint8_t*)statusBuffer, len);
+    } else {
+      platformLog("状态数据过大，未发送\n");
+    }
+
+    lastSentTemp = temp;
+    lastSentState = state;
+    lastSentSegment = segment;
+    statusDirty = false;
+    previousMillis = currentMillis; // 更新上次发送状态的时间
+}
+
+// 按键事件处理，在命令任务中执行，与主循环中的按键序列互不阻塞
+void handleButtonEvent(ButtonEvent event) {
+    uint8_t traceEvent = event;
+    traceRecord(TRACE_BUTTON, &traceEvent, sizeof(traceEvent));
+
+    switch (event) {
+        case BUTTON_SHORT_PRESS:
+            break;
+
+        case BUTTON_LONG_HOLD:
+            currentState = RECEIVING_SUCCESS;
+            break;
+
+        case BUTTON_LONG_PRESS:
+            platformLog("即将执行设定值\n");
+            if(deviceConnected){
+              currentState = EXECUTING;
+            }else{
+              currentState = EXECUTING_WITHOUT_CONECT;
+            }
+            startSettingRequested = true;
+            break;
+
+        case BUTTON_RESET_HOLD:
+            resetSetting();
+            platformLog("清除数据，即将重启");
+            currentState = CONNECTION_SUCCESS;
+            platformDelay(3000); // 留出时间显示 LED 状态
+            platformRestart();
+            break;
+    }
+}
+
+void controllerBegin() {
+    // 恢复上电时的运行状态（主机回放工具模拟重启时也会调用）
+    currentState = WAITING_FOR_CONNECTION;
+    startSettingRequested = false;
+    currentEvent = 0;
+    lastPrintTime = 0;
+    lastInterpolationTime = 0;
+    previousMillis = 0;
+    statusMinInterval = 1000;
+    statusHeartbeat = interval;
+    statusFields = STATUS_FIELD_RUNTIME | STATUS_FIELD_CURRENT_TEMPERATURE;
+    statusDirty = true;
+    lastSentTemp = -1;
+    lastSentState = -1;
+    lastSentSegment = -1;
+    tempPreviousMillis = 0;
+    isStart = 0;
+    isInterpolated = 0;
+    otaRestartAt = 0;
+    traceLength = 0;
+    traceRecording = false;
+    traceTruncated = false;
+    deviceConnected = false;
+    isRunning = false;
+    hasSentTemperaturePoints = false;
+    NowTemp = 0;
+
+    // 打印EEPROM原始值
+    platformLog("EEPROM原始数据:\n");
+    for (int i = 0; i < EEPROM_SIZE; i++) {
+        platformLog("0x%02X ", platformStorageRead(i));
+        if ((i + 1) % BYTES_PER_POINT == 0) platformLog("\n");
+    }
+
+    // 打印EEPROM解析后的温控点数据
+    platformLog("EEPROM解析后的温控点数据:\n");
+    for (int i = 0; i < MAX_TEMPERATURE_POINTS; i++) {
+        int addr = i * BYTES_PER_POINT;
+        uint8_t timeLow = platformStorageRead(addr);
+        uint8_t timeHigh = platformStorageRead(addr + 1);
+        uint8_t tempLow = platformStorageRead(addr + 2);
+        uint8_t tempHigh = platformStorageRead(addr + 3);
+
+        int time = (timeHigh << 8) | timeLow;
+        int temperature = (tempHigh << 8) | tempLow;
+
+        // 排除时间为0或65535的温控点
+        if (time >= 0 && time < 1000) { // 假设时间不会超过1000分钟
+            platformLog("温控点 %d - 时间: %d 分钟, 温度: %d°C\n", i + 1, time, temperature);
+        } else {
+            platformLog("温控点 %d - 未设置或无效的数据，跳过\n", i + 1);
+        }
+    }
+
+    // 可选：检查 EEPROM 是否已初始化（例如，检查第一个温控点时间是否为0或0xFFFF）
+    int firstTime = platformStorageRead(0) | (platformStorageRead(1) << 8);
+    if (firstTime == 0xFFFF) { // 假设0xFFFF或0x0000表示未初始化
+        platformLog("EEPROM未初始化，进行初始化\n");
+        for (int i = 0; i < MAX_TEMPERATURE_POINTS; i++) {
+            int addr = i * BYTES_PER_POINT;
+            platformStorageWrite(addr, 0);       // 时间低字节
+            platformStorageWrite(addr + 1, 0);   // 时间高字节
+            platformStorageWrite(addr + 2, 0);   // 温度低字节
+            platformStorageWrite(addr + 3, 0);   // 温度高字节
+        }
+        platformStorageCommit();
+        platformLog("EEPROM已初始化\n");
+    } else {
+        platformLog("EEPROM已包含温控点数据\n");
+    }
+
+    startTime = platformMillis();   // 重置开始时间
+}
+
+void controllerLoop() {
+    if (deviceConnected && !hasSentTemperaturePoints) {
+        sendTemperaturePoints();
+        hasSentTemperaturePoints = true;
+    }
+
+  if (deviceConnected) {
+    // 发送实时状态（变化驱动 + 心跳）
+    sendStatusIfNeeded();
+  }
+
+  // 按键或 start_run 请求的执行设定值在主循环中处理，不会打断正在进行的 tempEvent()
+  if (startSettingRequested) {
+    startSettingRequested = false;
+    executeSetting();
+  }
+
+  // OTA 切换分区后，等待响应发出再重启
+  if (otaRestartAt != 0 && platformMillis() - otaRestartAt >= OTA_RESTART_DELAY) {
+    platformRestart();
+  }
+
+  if (isStart && (platformMillis()-tempPreviousMillis >= TEMP_EVENT_INTERVAL_MS)){
+      printTime();  // 打印时间
+      tempEvent();  // 处理温度事件
+    tempPreviousMillis = platformMillis();
+  }
+}
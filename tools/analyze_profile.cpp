@@ -0,0 +1,47 @@
+// 温控曲线代价分析主机工具，与固件 analyze_profile 命令使用同一份分析代码
+// 编译：g++ -std=c++11 -Iinclude tools/analyze_profile.cpp -o analyze_profile
+// 用法：每行一个温控点 "分钟 温度"，从标准输入读取
+//   printf "0 25\n30 80\n60 80\n" | ./analyze_profile
+#include <stdio.h>
+#include "profile_analyzer.h"
+
+int main() {
+    ProfilePoint points[MAX_TEMPERATURE_POINTS];
+    int count = 0;
+    while (count < MAX_TEMPERATURE_POINTS &&
+           scanf("%d %d", &points[count].time, &points[count].temperature) == 2) {
+        count++;
+    }
+    if (count == 0) {
+        fprintf(stderr, "未读取到温控点\n");
+        return 1;
+    }
+
+    ProfileAnalysis analysis;
+    int eventLimit = count < MAX_TEMPERATURE_POINTS - 1 ? count : MAX_TEMPERATURE_POINTS - 1;
+    if (!analyzeProfile(points, count, eventLimit,
+                        TEMP_EVENT_INTERVAL_MS, INTERPOLATION_INTERVAL_MINUTES, 2 * TEMP_EVENT_INTERVAL_MS,
+                        analysis)) {
+        fprintf(stderr, "温控点无效：时间须在 0~%d 分钟之间，温度须在 0~%d 之间\n",
+                ANALYSIS_MAX_MINUTES - 1, ANALYSIS_MAX_TEMPERATURE);
+        return 1;
+    }
+
+    printf("presses:          %u\n", (unsigned)analysis.presses);
+    printf("updates:          %u\n", (unsigned)analysis.updates);
+    printf("blocked_ms:       %u\n", (unsigned)analysis.blockedMs);
+    printf("duration_ms:      %u\n", (unsigned)analysis.durationMs);
+    printf("blocked_permille: %u\n",
+           analysis.durationMs ? (unsigned)((uint64_t)analysis.blockedMs * 1000 / analysis.durationMs) : 0);
+    printf("worst_lag_ms:     %u (minute %d)\n", (unsigned)analysis.worstLagMs, analysis.worstLagMinute);
+    printf("max_error:        %d\n", analysis.maxError);
+
+    printf("dropped (%d):", analysis.droppedCount);
+    for (int i = 0; i < analysis.droppedCount && i < ANALYSIS_MAX_REPORTED_MINUTES; i++) printf(" %d", analysis.dropped[i]);
+    printf("\ndelayed (%d):", analysis.delayedCount);
+    for (int i = 0; i < analysis.delayedCount && i < ANALYSIS_MAX_REPORTED_MINUTES; i++) printf(" %d", analysis.delayed[i]);
+    printf("\n");
+
+    // 存在丢弃或延迟的分钟时返回非零，便于上传前把关
+    return (analysis.droppedCount > 0 || analysis.delayedCount > 0) ? 2 : 0;
+}
@@ -0,0 +1,362 @@
+// BLE 固件升级传输基准测试（主机工具），与固件使用同一份 OtaReceiver
+// 用内存中的 flash 替身和脚本化的 BLE 主机在虚拟时钟下模拟整条传输流水线，不需要真实射频
+// 编译：g++ -std=c++11 -O2 -Iinclude tools/ota_benchmark.cpp -o ota_benchmark
+// 用法：./ota_benchmark                  按 MTU x 窗口扫描默认配置
+//       ./ota_benchmark mtu=247 window=8192 loss=0.01 disconnect=0.5
+// 参数：image=字节 mtu= window= interval=连接间隔(ms) packets=每个连接事件的包数
+//       loss=丢包率 disconnect=断开位置(0~1) reconnect=重连耗时(ms)
+//       erase=扇区擦除(ms) page=256 字节页写入(us) seed=随机种子
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "ota_receiver.h"
+
+// 默认分区表中 OTA 分区大小
+const uint32_t PARTITION_SIZE = 0x140000;
+const uint32_t FLASH_SECTOR_SIZE = 4096;
+const uint32_t FLASH_PAGE_SIZE = 256;
+const int ACK_TIMEOUT_EVENTS = 20; // 窗口已满且这么多个连接事件没有确认时，查询状态并从确认处重发
+
+struct BenchConfig {
+    uint32_t image = 1024 * 1024;
+    uint32_t mtu = 517;
+    uint32_t window = OTA_DEFAULT_WINDOW;
+    double interval = 15;       // 连接间隔（毫秒）
+    int packets = 6;            // 每个连接事件最多发送的包数
+    double loss = 0;            // 丢包率
+    double disconnect = -1;     // 传输到该比例时断开一次，负数表示不断开
+    double reconnect = 2000;    // 断开后重连耗时（毫秒）
+    double erase = 45;          // 扇区擦除耗时（毫秒）
+    double page = 600;          // 页写入耗时（微秒）
+    unsigned seed = 1;
+};
+
+struct BenchResult {
+    bool verified;
+    double seconds;          // 虚拟时间
+    double bytesPerSecond;
+    uint32_t events;         // 连接事件数
+    uint32_t packets;        // 发送的数据包数
+    uint32_t acks;
+    uint32_t rewinds;        // 重发次数（乱序确认或超时）
+    double flashBusy;        // 设备处于写入/擦除的时间占比
+    double hostMicros;       // 主机上 OtaReceiver + SHA-256 的实际耗时
+};
+
+// ---- SHA-256（主机端软件实现，固件中使用 mbedtls）----
+struct Sha256 {
+    uint32_t h[8];
+    uint8_t block[64];
+    uint64_t length;
+    size_t used;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void start() {
+        static const uint32_t init[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        memcpy(h, init, sizeof(h));
+        length = 0;
+        used = 0;
+    }
+
+    void transform() {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+
+    void update(const uint8_t *data, size_t len) {
+        length += len;
+        while (len > 0) {
+            size_t n = 64 - used < len ? 64 - used : len;
+            memcpy(block + used, data, n);
+            used += n;
+            data += n;
+            len -= n;
+            if (used == 64) {
+                transform();
+                used = 0;
+            }
+        }
+    }
+
+    void finish(uint8_t digest[32]) {
+        uint64_t bits = length * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (used != 56) update(&pad, 1);
+        uint8_t lengthBytes[8];
+        for (int i = 0; i < 8; i++) lengthBytes[i] = bits >> (56 - i * 8);
+        update(lengthBytes, 8);
+        for (int i = 0; i < 8; i++) {
+            digest[i * 4] = h[i] >> 24;
+            digest[i * 4 + 1] = h[i] >> 16;
+            digest[i * 4 + 2] = h[i] >> 8;
+            digest[i * 4 + 3] = h[i];
+        }
+    }
+};
+
+// ---- 虚拟时钟下的设备端：flash 替身 ----
+struct PendingAck {
+    double at;        // 设备发出确认的虚拟时间（毫秒）
+    uint32_t offset;
+    bool rewind;
+};
+
+class FlashStandIn: public OtaPlatform {
+public:
+    FlashStandIn(const BenchConfig &config) : config(config) {}
+
+    double clock = 0;      // 设备当前处理到的虚拟时间（毫秒）
+    double busy = 0;       // 写入/擦除累计耗时（毫秒）
+    double hostMicros = 0;
+    std::vector<uint8_t> flash;
+    std::deque<PendingAck> acks;
+    bool activated = false;
+
+    uint32_t partitionSize() override { return PARTITION_SIZE; }
+
+    bool flashBegin(uint32_t size) override {
+        flash.clear();
+        flash.reserve(size);
+        return true;
+    }
+
+    // 顺序写入：进入新扇区时先擦除，再按页写入
+    bool flashWrite(const uint8_t *data, size_t length) override {
+        uint32_t start = flash.size();
+        uint32_t end = start + length;
+        double cost = 0;
+        uint32_t firstSector = (start + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+        uint32_t lastSector = (end + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+        cost += (lastSector - firstSector) * config.erase;
+        cost += (double)length / FLASH_PAGE_SIZE * config.page / 1000;
+        clock += cost;
+        busy += cost;
+        flash.insert(flash.end(), data, data + length);
+        return true;
+    }
+
+    bool flashEnd() override { return true; }
+    void flashAbort() override { flash.clear(); }
+    bool activate() override { activated = true; return true; }
+
+    void shaStart() override { sha.start(); }
+    void shaUpdate(const uint8_t *data, size_t length) override { sha.update(data, length); }
+    void shaFinish(uint8_t digest[32]) override { sha.finish(digest); }
+
+    void sendAck(uint32_t offset, bool rewind) override {
+        PendingAck ack = {clock, offset, rewind};
+        acks.push_back(ack);
+    }
+
+    unsigned long now() override { return (unsigned long)clock; }
+
+private:
+    const BenchConfig &config;
+    Sha256 sha;
+};
+
+// ---- 脚本化 BLE 主机 ----
+double randomUnit() {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+BenchResult runBenchmark(const BenchConfig &config) {
+    srand(config.seed);
+    std::vector<uint8_t> image(config.image);
+    for (uint32_t i = 0; i < config.image; i++) image[i] = rand() & 0xFF;
+
+    Sha256 sha;
+    uint8_t digest[32];
+    char shaHex[OTA_SHA256_HEX_LENGTH + 1];
+    sha.start();
+    sha.update(image.data(), image.size());
+    sha.finish(digest);
+    for (int i = 0; i < 32; i++) snprintf(shaHex + i * 2, 3, "%02x", digest[i]);
+
+    FlashStandIn device(config);
+    OtaReceiver receiver(device);
+    BenchResult result = BenchResult();
+
+    uint32_t payload = config.mtu - 3 - OTA_PACKET_HEADER; // ATT 头 3 字节
+    std::vector<uint8_t> packet(OTA_PACKET_HEADER + payload);
+
+    // ota_begin，回复中的 offset 即续传起点
+    receiver.begin(config.image, shaHex, config.window);
+    uint32_t sendOffset = receiver.offset();
+    uint32_t acked = receiver.offset();
+    double t = 0;
+    int idleEvents = 0;
+    bool disconnected = config.disconnect < 0;
+
+    while (acked < config.image) {
+        // 连接事件：先收到设备在此之前发出的确认
+        bool progressed = false;
+        while (!device.acks.empty() && device.acks.front().at <= t) {
+            PendingAck ack = device.acks.front();
+            device.acks.pop_front();
+            result.acks++;
+            if (ack.rewind) {
+                sendOffset = ack.offset;
+                acked = ack.offset;
+                result.rewinds++;
+            } else if (ack.offset > acked) {
+                acked = ack.offset;
+            }
+            progressed = true;
+        }
+        if (acked >= config.image) break;
+
+        // 窗口已满长时间没有确认（例如最后一个包丢失），查询 ota_status 后从设备偏移重发
+        if (progressed) {
+            idleEvents = 0;
+        } else if (sendOffset - acked >= receiver.window() && ++idleEvents >= ACK_TIMEOUT_EVENTS) {
+            acked = receiver.offset();
+            sendOffset = acked;
+            result.rewinds++;
+            idleEvents = 0;
+        }
+
+        // 模拟一次断开：在途数据丢失，重连后重新发送 ota_begin 续传
+        if (!disconnected && acked >= config.image * config.disconnect) {
+            disconnected = true;
+            t += config.reconnect;
+            if (device.clock < t) device.clock = t;
+            device.acks.clear();
+            receiver.begin(config.image, shaHex, config.window);
+            sendOffset = receiver.offset();
+            acked = receiver.offset();
+            continue;
+        }
+
+        // 无响应写入：在窗口允许的范围内发送，设备按到达顺序处理
+        result.events++;
+        for (int i = 0; i < config.packets && sendOffset < config.image &&
+                        sendOffset - acked < receiver.window(); i++) {
+            uint32_t length = config.image - sendOffset < payload ? config.image - sendOffset : payload;
+            packet[0] = sendOffset & 0xFF;
+            packet[1] = (sendOffset >> 8) & 0xFF;
+            packet[2] = (sendOffset >> 16) & 0xFF;
+            packet[3] = (sendOffset >> 24) & 0xFF;
+            memcpy(packet.data() + OTA_PACKET_HEADER, image.data() + sendOffset, length);
+            sendOffset += length;
+            result.packets++;
+
+            if (config.loss > 0 && randomUnit() < config.loss) continue;
+
+            if (device.clock < t) device.clock = t;
+            auto start = std::chrono::steady_clock::now();
+            receiver.handlePacket(packet.data(), OTA_PACKET_HEADER + length);
+            auto stop = std::chrono::steady_clock::now();
+            device.hostMicros += std::chrono::duration<double, std::micro>(stop - start).count();
+        }
+        t += config.interval;
+    }
+
+    // ota_end：校验 SHA-256 并切换分区
+    if (device.clock > t) t = device.clock;
+    result.verified = receiver.end(false) == OTA_OK && device.activated &&
+                      device.flash.size() == image.size() &&
+                      memcmp(device.flash.data(), image.data(), image.size()) == 0;
+    result.seconds = t / 1000;
+    result.bytesPerSecond = t > 0 ? config.image * 1000.0 / t : 0;
+    result.flashBusy = t > 0 ? device.busy / t : 0;
+    result.hostMicros = device.hostMicros;
+    return result;
+}
+
+void printResult(const BenchConfig &config, const BenchResult &result) {
+    printf("%5u %7u %9.1f %8.2f %8u %7u %7u %7u %6.1f%% %9.0f %s\n",
+           config.mtu, config.window, result.bytesPerSecond / 1024, result.seconds,
+           result.events, result.packets, result.acks, result.rewinds,
+           result.flashBusy * 100, result.hostMicros, result.verified ? "ok" : "FAILED");
+}
+
+bool parseArg(BenchConfig &config, const char *arg) {
+    const char *eq = strchr(arg, '=');
+    if (eq == nullptr) return false;
+    size_t keyLength = eq - arg;
+    const char *value = eq + 1;
+    if (strncmp(arg, "image", keyLength) == 0) config.image = strtoul(value, nullptr, 0);
+    else if (strncmp(arg, "mtu", keyLength) == 0) config.mtu = strtoul(value, nullptr, 0);
+    else if (strncmp(arg, "window", keyLength) == 0) config.window = strtoul(value, nullptr, 0);
+    else if (strncmp(arg, "interval", keyLength) == 0) config.interval = atof(value);
+    else if (strncmp(arg, "packets", keyLength) == 0) config.packets = atoi(value);
+    else if (strncmp(arg, "loss", keyLength) == 0) config.loss = atof(value);
+    else if (strncmp(arg, "disconnect", keyLength) == 0) config.disconnect = atof(value);
+    else if (strncmp(arg, "reconnect", keyLength) == 0) config.reconnect = atof(value);
+    else if (strncmp(arg, "erase", keyLength) == 0) config.erase = atof(value);
+    else if (strncmp(arg, "page", keyLength) == 0) config.page = atof(value);
+    else if (strncmp(arg, "seed", keyLength) == 0) config.seed = strtoul(value, nullptr, 0);
+    else return false;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config;
+    for (int i = 1; i < argc; i++) {
+        if (!parseArg(config, argv[i])) {
+            fprintf(stderr, "未知参数: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (config.mtu <= 3 + OTA_PACKET_HEADER || config.image == 0 || config.image > PARTITION_SIZE) {
+        fprintf(stderr, "MTU 过小或固件大小超出分区\n");
+        return 1;
+    }
+
+    printf("image %u B, interval %.1f ms, %d packets/event, loss %.3f, erase %.0f ms/sector, page %.0f us\n",
+           config.image, config.interval, config.packets, config.loss, config.erase, config.page);
+    printf("  mtu  window      KB/s  seconds   events packets    acks rewinds  flash   host_us result\n");
+
+    bool ok = true;
+    if (argc > 1) {
+        BenchResult result = runBenchmark(config);
+        printResult(config, result);
+        ok = result.verified;
+    } else {
+        const uint32_t mtus[] = {23, 185, 247, 517};
+        const uint32_t windows[] = {1024, 4096, 16384};
+        for (uint32_t mtu : mtus) {
+            for (uint32_t window : windows) {
+                BenchConfig sweep = config;
+                sweep.mtu = mtu;
+                sweep.window = window;
+                BenchResult result = runBenchmark(sweep);
+                printResult(sweep, result);
+                ok = ok && result.verified;
+            }
+        }
+    }
+    return ok ? 0 : 2;
+}
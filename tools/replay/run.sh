@@ -0,0 +1,27 @@
+#!/bin/sh
+# 编译回放工具并逐个回放本目录下的示例轨迹，与同名 .log 比较
+# 用法：tools/replay/run.sh [ArduinoJson 源码目录]，默认使用 PlatformIO 下载的版本（也可通过 ARDUINOJSON_SRC 指定）
+# 更新期望日志：UPDATE=1 tools/replay/run.sh
+set -e
+
+cd "$(dirname "$0")/../.."
+JSON_SRC="${1:-${ARDUINOJSON_SRC:-.pio/libdeps/esp32-c3-devkitm-1/ArduinoJson/src}}"
+BIN="${TMPDIR:-/tmp}/replay_trace"
+
+g++ -std=c++11 -O2 -Iinclude -I"$JSON_SRC" src/controller.cpp tools/replay_trace.cpp -o "$BIN"
+
+failed=0
+for trace in tools/replay/*.hex; do
+    golden="${trace%.hex}.log"
+    if [ -n "$UPDATE" ]; then
+        "$BIN" "$trace" tail=1 > "$golden" 2>/dev/null
+        echo "已更新 $golden"
+    elif "$BIN" "$trace" tail=1 expect="$golden" > "$BIN.out" 2>&1; then
+        echo "通过 $trace"
+    else
+        echo "失败 $trace"
+        grep -A2 "行不一致" "$BIN.out" || cat "$BIN.out"
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,434 @@
+// 命令轨迹回放（主机工具），与固件使用同一份命令处理和调度代码（src/controller.cpp）
+// 在虚拟时钟下按时间戳重放 trace_dump 导出的轨迹，记录温控器按键序列和 BLE 通知，并统计每条命令的耗时
+// 编译（ArduinoJson 使用 PlatformIO 下载的同一版本）：
+//   g++ -std=c++11 -O2 -Iinclude -I.pio/libdeps/esp32-c3-devkitm-1/ArduinoJson/src src/controller.cpp tools/replay_trace.cpp -o replay_trace
+// 用法：./replay_trace trace.hex                      输出事件日志，命令耗时输出到标准错误
+//       ./replay_trace trace.hex expect=golden.log    与期望的事件日志逐行比较，不一致时返回 2
+//       ./replay_trace trace.hex tail=30 log=1        最后一条记录后继续运行 30 分钟，并输出固件串口日志
+// 轨迹文件为各 trace_chunk 中 data 字段按 offset 顺序拼接的十六进制，空白忽略；"-" 表示标准输入。
+// 回放从上电状态开始（EEPROM 为空）；trace_start 录制的轨迹以状态快照开头，先恢复快照中的 EEPROM、
+// 曲线进度和连接状态。既没有快照也不是以连接开始的轨迹先模拟一次连接。
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ArduinoJson.h>
+#include "controller.h"
+
+const unsigned long LOOP_STEP_MS = 1;       // 两次 controllerLoop() 之间虚拟时钟前进的时间
+const unsigned long KEY_BURST_GAP_MS = 500; // 按键间隔超过该值时视为新的一组按键序列
+
+// ---- 虚拟设备 ----
+unsigned long virtualMillis = 0;
+uint8_t storage[EEPROM_SIZE];
+bool restartRequested = false;
+bool serialLog = false;
+
+// 事件日志：每行 "时间(ms) 事件"，用于与期望日志比较
+std::vector<std::string> events;
+
+// 当前一组按键（温控器面板上的一次 setTemp() 等）
+std::string keyBurst;
+unsigned long keyBurstStart = 0;
+unsigned long keyLastRelease = 0;
+
+void logEvent(unsigned long at, const std::string &text) {
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "%8lu ", at);
+    events.push_back(prefix + text);
+    printf("%s\n", events.back().c_str());
+}
+
+// 按 setTempZero() + setTemp() 的按键模式解出写入的温度，不匹配时返回 -1
+int decodeSetTemp(const std::string &keys) {
+    const std::string prefix = "14442211";
+    if (keys.compare(0, prefix.size(), prefix) != 0) return -1;
+    int digits[3] = {0, 0, 0};
+    int position = 0;
+    for (size_t i = prefix.size(); i < keys.size(); i++) {
+        char key = keys[i];
+        if (key == '3') {
+            digits[position]++;
+        } else if (key == '4' && position < 2) {
+            position++;
+        } else if (key == '1' && position == 2 && i == keys.size() - 1) {
+            return digits[2] * 100 + digits[1] * 10 + digits[0];
+        } else {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+void flushKeyBurst() {
+    if (keyBurst.empty()) return;
+    std::string text = "keys " + keyBurst;
+    int temperature = decodeSetTemp(keyBurst);
+    if (temperature >= 0) {
+        text += " set " + std::to_string(temperature);
+    }
+    logEvent(keyBurstStart, text);
+    keyBurst.clear();
+}
+
+void logDeviceEvent(const std::string &text) {
+    flushKeyBurst();
+    logEvent(virtualMillis, text);
+}
+
+// ---- 平台钩子（声明见 controller.h）----
+unsigned long platformMillis() {
+    return virtualMillis;
+}
+
+unsigned long platformMicros() {
+    return virtualMillis * 1000;
+}
+
+void platformDelay(unsigned long ms) {
+    virtualMillis += ms;
+}
+
+// 按键记为面板编号 1~4（KEY1 设定、KEY2 减、KEY3 加、KEY4 左移），只在按下时记录
+void platformKeyWrite(int key, bool pressed) {
+    if (!pressed) {
+        keyLastRelease = virtualMillis;
+        return;
+    }
+    if (!keyBurst.empty() && virtualMillis - keyLastRelease > KEY_BURST_GAP_MS) {
+        flushKeyBurst();
+    }
+    if (keyBurst.empty()) keyBurstStart = virtualMillis;
+
+    char name = '?';
+    if (key == KEY1) name = '1';
+    else if (key == KEY2) name = '2';
+    else if (key == KEY3) name = '3';
+    else if (key == KEY4) name = '4';
+    keyBurst += name;
+}
+
+void platformNotify(const uint8_t *data, size_t length) {
+    logDeviceEvent("notify " + std::string((const char*)data, length));
+}
+
+uint8_t platformStorageRead(int addr) {
+    return addr >= 0 && addr < EEPROM_SIZE ? storage[addr] : 0xFF;
+}
+
+void platformStorageWrite(int addr, uint8_t value) {
+    if (addr >= 0 && addr < EEPROM_SIZE) storage[addr] = value;
+}
+
+bool platformStorageCommit() {
+    return true;
+}
+
+void platformLog(const char *format, ...) {
+    if (!serialLog) return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+// 固件中不会返回；回放时记录下来，在当前调用返回后重新初始化
+void platformRestart() {
+    if (!restartRequested) logDeviceEvent("restart");
+    restartRequested = true;
+}
+
+// 轨迹不记录链路加密状态，回放时视为已配对
+bool platformLinkSecure() {
+    return true;
+}
+
+void platformLock() {
+}
+
+void platformUnlock() {
+}
+
+// 轨迹中不含 OTA 数据包，只需让 ota_* 命令按固件逻辑返回状态
+class ReplayOtaPlatform: public OtaPlatform {
+public:
+    uint32_t partitionSize() override { return 0x140000; }
+    bool flashBegin(uint32_t size) override { return true; }
+    bool flashWrite(const uint8_t *data, size_t length) override { return true; }
+    bool flashEnd() override { return true; }
+    void flashAbort() override {}
+    bool activate() override { return true; }
+    void shaStart() override {}
+    void shaUpdate(const uint8_t *data, size_t length) override {}
+    void shaFinish(uint8_t digest[32]) override { memset(digest, 0, 32); }
+
+    void sendAck(uint32_t offset, bool rewind) override {
+        char buffer[96];
+        int len = snprintf(buffer, sizeof(buffer),
+                           "{\"command\":\"ota_ack\",\"offset\":%u,\"rewind\":%s}",
+                           (unsigned)offset, rewind ? "true" : "false");
+        platformNotify((const uint8_t*)buffer, len);
+    }
+
+    unsigned long now() override { return virtualMillis; }
+};
+
+ReplayOtaPlatform otaPlatform;
+OtaReceiver ota(otaPlatform);
+
+void powerOn() {
+    restartRequested = false;
+    ota.abort();
+    controllerBegin();
+}
+
+void afterCall() {
+    if (restartRequested) powerOn();
+}
+
+// 主循环运行到虚拟时间 until
+void runUntil(unsigned long until) {
+    while (virtualMillis < until) {
+        controllerLoop();
+        afterCall();
+        virtualMillis += LOOP_STEP_MS;
+    }
+}
+
+// ---- 轨迹 ----
+struct TraceRecord {
+    uint32_t timestamp;
+    uint8_t type;
+    std::vector<uint8_t> data;
+};
+
+struct CommandTiming {
+    std::string name;
+    unsigned long at;
+    unsigned long virtualMs;  // 命令处理期间的延时（按键序列、响应前等待）
+    double hostMicros;        // 主机上解析和执行的实际耗时
+    long deviceMicros;        // 轨迹中记录的设备端处理耗时，-1 表示未记录
+};
+
+bool readFile(const char *path, std::string &out) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == NULL) return false;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) out.append(buffer, n);
+    if (file != stdin) fclose(file);
+    return true;
+}
+
+bool parseHex(const std::string &text, std::vector<uint8_t> &out) {
+    int high = -1;
+    for (char c : text) {
+        int value;
+        if (c >= '0' && c <= '9') value = c - '0';
+        else if (c >= 'a' && c <= 'f') value = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value = c - 'A' + 10;
+        else if (c == ' ' || c == '\n' || c == '\r' || c == '\t') continue;
+        else return false;
+
+        if (high < 0) {
+            high = value;
+        } else {
+            out.push_back((high << 4) | value);
+            high = -1;
+        }
+    }
+    return high < 0;
+}
+
+bool parseTrace(const std::vector<uint8_t> &bytes, std::vector<TraceRecord> &records) {
+    size_t pos = 0;
+    while (pos < bytes.size()) {
+        if (pos + TRACE_RECORD_HEADER > bytes.size()) return false;
+        const uint8_t *p = bytes.data() + pos;
+        TraceRecord record;
+        record.timestamp = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        record.type = p[4];
+        size_t length = p[5] | (p[6] << 8);
+        pos += TRACE_RECORD_HEADER;
+        if (pos + length > bytes.size()) return false;
+        record.data.assign(bytes.begin() + pos, bytes.begin() + pos + length);
+        pos += length;
+        records.push_back(record);
+    }
+    return true;
+}
+
+const char* buttonName(uint8_t event) {
+    switch (event) {
+        case BUTTON_SHORT_PRESS: return "short_press";
+        case BUTTON_LONG_HOLD:   return "long_hold";
+        case BUTTON_LONG_PRESS:  return "long_press";
+        case BUTTON_RESET_HOLD:  return "reset_hold";
+        default:                 return NULL;
+    }
+}
+
+// 命令名，批量命令为 batch(N)
+std::string commandName(const std::vector<uint8_t> &data) {
+    DynamicJsonDocument doc(20480);
+    if (deserializeJson(doc, (const char*)data.data(), data.size())) return "(invalid)";
+    if (doc.is<JsonArray>()) return "batch(" + std::to_string(doc.as<JsonArray>().size()) + ")";
+    const char *name = doc["command"];
+    return name ? name : "(none)";
+}
+
+bool parseArg(const char *arg, std::string &tracePath, std::string &expectPath, unsigned long &tailMinutes) {
+    if (strncmp(arg, "expect=", 7) == 0) expectPath = arg + 7;
+    else if (strncmp(arg, "tail=", 5) == 0) tailMinutes = strtoul(arg + 5, NULL, 10);
+    else if (strncmp(arg, "log=", 4) == 0) serialLog = atoi(arg + 4) != 0;
+    else if (strchr(arg, '=') == NULL && tracePath.empty()) tracePath = arg;
+    else return false;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string tracePath, expectPath;
+    unsigned long tailMinutes = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!parseArg(argv[i], tracePath, expectPath, tailMinutes)) {
+            fprintf(stderr, "未知参数: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (tracePath.empty()) {
+        fprintf(stderr, "用法: replay_trace trace.hex [expect=期望日志] [tail=分钟] [log=1]\n");
+        return 1;
+    }
+
+    std::string text;
+    std::vector<uint8_t> bytes;
+    std::vector<TraceRecord> records;
+    if (!readFile(tracePath.c_str(), text)) {
+        fprintf(stderr, "无法读取轨迹文件: %s\n", tracePath.c_str());
+        return 1;
+    }
+    if (!parseHex(text, bytes) || !parseTrace(bytes, records)) {
+        fprintf(stderr, "轨迹格式错误\n");
+        return 1;
+    }
+
+    memset(storage, 0xFF, sizeof(storage));
+    powerOn();
+    // 带快照的轨迹由快照恢复连接状态
+    if (records.empty() || (records[0].type != TRACE_CONNECT && records[0].type != TRACE_SNAPSHOT)) {
+        logDeviceEvent("connect");
+        handleConnect();
+    }
+
+    std::vector<CommandTiming> timings;
+    size_t pendingTiming = 0; // 下一个等待 TRACE_COMMAND_DONE 的命令
+    unsigned long base = virtualMillis;
+    for (const TraceRecord &record : records) {
+        runUntil(base + record.timestamp);
+
+        switch (record.type) {
+            case TRACE_COMMAND: {
+                CommandTiming timing;
+                timing.name = commandName(record.data);
+                timing.at = virtualMillis;
+                timing.deviceMicros = -1;
+                logDeviceEvent("command " + std::string(record.data.begin(), record.data.end()));
+
+                auto hostStart = std::chrono::steady_clock::now();
+                handleWrite(record.data.data(), record.data.size());
+                auto hostEnd = std::chrono::steady_clock::now();
+                timing.hostMicros = std::chrono::duration<double, std::micro>(hostEnd - hostStart).count();
+                timing.virtualMs = virtualMillis - timing.at;
+                timings.push_back(timing);
+                afterCall();
+                break;
+            }
+            case TRACE_COMMAND_DONE:
+                // trace_start 本身的完成记录没有对应的命令记录，忽略
+                if (record.data.size() == 4 && pendingTiming < timings.size()) {
+                    const uint8_t *p = record.data.data();
+                    timings[pendingTiming++].deviceMicros = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+                }
+                break;
+            case TRACE_SNAPSHOT: {
+                if (!restoreSnapshot(record.data.data(), record.data.size())) {
+                    fprintf(stderr, "无效的快照记录\n");
+                    return 1;
+                }
+                const uint8_t *p = record.data.data() + EEPROM_SIZE;
+                char text[96];
+                snprintf(text, sizeof(text), "snapshot flags %u segment %u elapsed %lus temp %u",
+                         p[0], p[1], (unsigned long)(p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24)) / 1000,
+                         p[14] | (p[15] << 8));
+                logDeviceEvent(text);
+                break;
+            }
+            case TRACE_CONNECT:
+                logDeviceEvent("connect");
+                handleConnect();
+                break;
+            case TRACE_DISCONNECT:
+                logDeviceEvent("disconnect");
+                handleDisconnect();
+                break;
+            case TRACE_BUTTON: {
+                const char *name = record.data.size() == 1 ? buttonName(record.data[0]) : NULL;
+                if (name == NULL) {
+                    fprintf(stderr, "无效的按键记录\n");
+                    return 1;
+                }
+                logDeviceEvent(std::string("button ") + name);
+                handleButtonEvent((ButtonEvent)record.data[0]);
+                afterCall();
+                break;
+            }
+            default:
+                fprintf(stderr, "未知记录类型: %d\n", record.type);
+                return 1;
+        }
+    }
+    runUntil(virtualMillis + tailMinutes * 60000);
+    flushKeyBurst();
+
+    // 每条命令的耗时
+    fprintf(stderr, "   #  at_ms    command                    virtual_ms   host_us  device_us\n");
+    for (size_t i = 0; i < timings.size(); i++) {
+        const CommandTiming &timing = timings[i];
+        char device[24] = "-";
+        if (timing.deviceMicros >= 0) snprintf(device, sizeof(device), "%ld", timing.deviceMicros);
+        fprintf(stderr, "%4d %8lu  %-26s %10lu %9.1f %10s\n", (int)i + 1, timing.at, timing.name.c_str(),
+                timing.virtualMs, timing.hostMicros, device);
+    }
+
+    if (expectPath.empty()) return 0;
+
+    std::string expected;
+    if (!readFile(expectPath.c_str(), expected)) {
+        fprintf(stderr, "无法读取期望日志: %s\n", expectPath.c_str());
+        return 1;
+    }
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while (start < expected.size()) {
+        size_t end = expected.find('\n', start);
+        if (end == std::string::npos) end = expected.size();
+        std::string line = expected.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) lines.push_back(line);
+        start = end + 1;
+    }
+
+    for (size_t i = 0; i < lines.size() || i < events.size(); i++) {
+        const char *want = i < lines.size() ? lines[i].c_str() : "(结束)";
+        const char *got = i < events.size() ? events[i].c_str() : "(结束)";
+        if (strcmp(want, got) != 0) {
+            fprintf(stderr, "第 %d 行不一致\n  期望: %s\n  实际: %s\n", (int)i + 1, want, got);
+            return 2;
+        }
+    }
+    fprintf(stderr, "与期望日志一致，共 %d 行\n", (int)events.size());
+    return 0;
+}